@@ -786,6 +786,7 @@ static double mapxstart=0; //x-value for the bitmap.
 static bool stopped = true;
 
 static void AM_calcMinMaxMtoF();
+static void AM_clearCullGrid();
 
 static void DrawMarker (FTexture *tex, double x, double y, int yadjust,
 	INTBOOL flip, double xscale, double yscale, int translation, double alpha, DWORD fillcolor, FRenderStyle renderstyle);
@@ -1329,6 +1330,7 @@ void AM_LevelInit ()
 	}
 
 	AM_clearMarks();
+	AM_clearCullGrid();
 
 	AM_findMinMaxBoundaries();
 	scale_mtof = min_scale_mtof / 0.7;
@@ -1879,6 +1881,248 @@ void AM_drawGrid (int color)
 	}
 }
 
+//=============================================================================
+//
+// Line culling
+//
+// The map is divided into AM_CULLBLOCK sized cells, and every line is
+// linked into each cell its bounding box touches, so only the lines near
+// the visible part of the map have to be transformed and clipped.
+// Polyobject lines move, so they are not put in the grid and are always
+// checked.
+//
+//=============================================================================
+
+enum { AM_CULLBLOCK = 512 };
+
+static bool CullGridValid;				// Cleared by AM_LevelInit
+static double CullOrgX, CullOrgY;
+static int CullWidth, CullHeight;
+static TArray<int> CullCellStart;		// CullWidth*CullHeight+1 indices into CullCellLines
+static TArray<int> CullCellLines;
+static TArray<int> CullPolyLines;
+static TArray<int> CullStamps;
+static int CullStamp;
+static TArray<int> CullVisible;			// Output of AM_collectLines
+static TArray<FBoundingBox> SubsectorBoxes;
+
+//=============================================================================
+//
+// The grid holds line and subsector indices of the current level, so it
+// has to be rebuilt for every new one.
+//
+//=============================================================================
+
+static void AM_clearCullGrid ()
+{
+	CullGridValid = false;
+}
+
+//=============================================================================
+//
+//
+//
+//=============================================================================
+
+static void AM_buildCullGrid ()
+{
+	double minx = FLT_MAX, miny = FLT_MAX, maxx = -FLT_MAX, maxy = -FLT_MAX;
+	int i;
+
+	CullGridValid = true;
+	CullCellLines.Clear();
+	CullPolyLines.Clear();
+
+	for (i = 0; i < numlines; i++)
+	{
+		if (!(lines[i].sidedef[0]->Flags & WALLF_POLYOBJ))
+		{
+			minx = MIN(minx, lines[i].bbox[BOXLEFT]);
+			maxx = MAX(maxx, lines[i].bbox[BOXRIGHT]);
+			miny = MIN(miny, lines[i].bbox[BOXBOTTOM]);
+			maxy = MAX(maxy, lines[i].bbox[BOXTOP]);
+		}
+	}
+	if (minx > maxx)
+	{
+		CullWidth = CullHeight = 0;
+	}
+	else
+	{
+		CullOrgX = minx;
+		CullOrgY = miny;
+		CullWidth = int((maxx - minx) / AM_CULLBLOCK) + 1;
+		CullHeight = int((maxy - miny) / AM_CULLBLOCK) + 1;
+	}
+
+	// Count the lines in each cell first, then fill them in.
+	CullCellStart.Resize(CullWidth * CullHeight + 1);
+	memset(&CullCellStart[0], 0, CullCellStart.Size() * sizeof(int));
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (i = 0; i < numlines; i++)
+		{
+			if (lines[i].sidedef[0]->Flags & WALLF_POLYOBJ)
+			{
+				if (pass == 0) CullPolyLines.Push(i);
+				continue;
+			}
+			int x1 = int((lines[i].bbox[BOXLEFT] - CullOrgX) / AM_CULLBLOCK);
+			int x2 = int((lines[i].bbox[BOXRIGHT] - CullOrgX) / AM_CULLBLOCK);
+			int y1 = int((lines[i].bbox[BOXBOTTOM] - CullOrgY) / AM_CULLBLOCK);
+			int y2 = int((lines[i].bbox[BOXTOP] - CullOrgY) / AM_CULLBLOCK);
+
+			for (int y = y1; y <= y2; y++)
+			{
+				for (int x = x1; x <= x2; x++)
+				{
+					int cell = y * CullWidth + x;
+					if (pass == 0) CullCellStart[cell + 1]++;
+					else CullCellLines[CullCellStart[cell]++] = i;
+				}
+			}
+		}
+		if (pass == 0)
+		{
+			for (unsigned j = 1; j < CullCellStart.Size(); j++)
+			{
+				CullCellStart[j] += CullCellStart[j - 1];
+			}
+			CullCellLines.Resize(CullCellStart.Last());
+		}
+		else
+		{
+			// Filling has moved every start to the start of the next cell.
+			for (unsigned j = CullCellStart.Size() - 1; j > 0; j--)
+			{
+				CullCellStart[j] = CullCellStart[j - 1];
+			}
+			CullCellStart[0] = 0;
+		}
+	}
+
+	CullStamps.Resize(numlines);
+	if (numlines > 0)
+	{
+		memset(&CullStamps[0], 0, numlines * sizeof(int));
+	}
+	CullStamp = 0;
+
+	// Subsectors do not move (polyobjects are drawn by their own segs),
+	// so their extents only need to be found once.
+	SubsectorBoxes.Resize(numsubsectors);
+	for (i = 0; i < numsubsectors; i++)
+	{
+		SubsectorBoxes[i].ClearBox();
+		for (DWORD j = 0; j < subsectors[i].numlines; j++)
+		{
+			SubsectorBoxes[i].AddToBox(subsectors[i].firstline[j].v1->fPos());
+		}
+	}
+}
+
+//=============================================================================
+//
+// AM_getVisibleBox
+//
+// Returns the unrotated map space extent of the given rectangle of the
+// rotated map, widened by a few pixels so that rounding in the clipper
+// cannot make a culled line show up.
+//
+//=============================================================================
+
+static void AM_getVisibleBox (double x1, double y1, double x2, double y2, FBoundingBox &box)
+{
+	double margin = 4 * scale_ftom + 1;
+	double cx[4] = { x1, x2, x1, x2 };
+	double cy[4] = { y1, y1, y2, y2 };
+
+	box.ClearBox();
+	for (int i = 0; i < 4; i++)
+	{
+		if (am_rotate == 1 || (am_rotate == 2 && viewactive))
+		{
+			// Undo AM_rotatePoint.
+			double pivotx = m_x + m_w/2;
+			double pivoty = m_y + m_h/2;
+			cx[i] -= pivotx;
+			cy[i] -= pivoty;
+			AM_rotate(&cx[i], &cy[i], players[consoleplayer].camera->Angles.Yaw - 90.);
+			cx[i] += pivotx;
+			cy[i] += pivoty;
+		}
+		box.AddToBox(DVector2(cx[i], cy[i]));
+	}
+	box = FBoundingBox(box.Left() - margin, box.Bottom() - margin, box.Right() + margin, box.Top() + margin);
+}
+
+//=============================================================================
+//
+// AM_collectLines
+//
+// Fills CullVisible with the lines that may be inside the given box, in
+// the order they have in the map so that overlapping lines are drawn the
+// same way as without the grid. Returns false if the box covers so much
+// of the map that going through all lines is faster.
+//
+//=============================================================================
+
+static int STACK_ARGS AM_compareLines (const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static bool AM_collectLines (double left, double bottom, double right, double top)
+{
+	int x1 = int(floor((left - CullOrgX) / AM_CULLBLOCK));
+	int x2 = int(floor((right - CullOrgX) / AM_CULLBLOCK));
+	int y1 = int(floor((bottom - CullOrgY) / AM_CULLBLOCK));
+	int y2 = int(floor((top - CullOrgY) / AM_CULLBLOCK));
+
+	x1 = MAX(x1, 0);
+	y1 = MAX(y1, 0);
+	x2 = MIN(x2, CullWidth - 1);
+	y2 = MIN(y2, CullHeight - 1);
+
+	if (x1 <= x2 && y1 <= y2 && (x2 - x1 + 1) * (y2 - y1 + 1) * 2 > CullWidth * CullHeight)
+	{
+		return false;
+	}
+
+	if (++CullStamp == 0)
+	{
+		memset(&CullStamps[0], 0, CullStamps.Size() * sizeof(int));
+		CullStamp = 1;
+	}
+	CullVisible.Clear();
+	for (int y = y1; y <= y2; y++)
+	{
+		for (int x = x1; x <= x2; x++)
+		{
+			int cell = y * CullWidth + x;
+			for (int j = CullCellStart[cell]; j < CullCellStart[cell + 1]; j++)
+			{
+				int line = CullCellLines[j];
+				if (CullStamps[line] != CullStamp)
+				{
+					CullStamps[line] = CullStamp;
+					CullVisible.Push(line);
+				}
+			}
+		}
+	}
+	for (unsigned j = 0; j < CullPolyLines.Size(); j++)
+	{
+		CullVisible.Push(CullPolyLines[j]);
+	}
+	if (CullVisible.Size() > 1)
+	{
+		qsort(&CullVisible[0], CullVisible.Size(), sizeof(int), AM_compareLines);
+	}
+	return true;
+}
+
 //=============================================================================
 //
 // AM_drawSubsectors
@@ -1896,6 +2140,15 @@ void AM_drawSubsectors()
 	double originx, originy;
 	FDynamicColormap *colormap;
 	mpoint_t originpt;
+	FBoundingBox view;
+
+	if (!CullGridValid)
+	{
+		AM_buildCullGrid();
+	}
+	// FillSimplePoly clips to the screen, not to the automap window.
+	AM_getVisibleBox(m_x - f_x * scale_ftom, m_y + (f_y + f_h - screen->GetHeight()) * scale_ftom,
+		m_x + (screen->GetWidth() - f_x) * scale_ftom, m_y + (f_y + f_h) * scale_ftom, view);
 
 	for (int i = 0; i < numsubsectors; ++i)
 	{
@@ -1904,6 +2157,13 @@ void AM_drawSubsectors()
 			continue;
 		}
 
+		const FBoundingBox &box = SubsectorBoxes[i];
+		if (box.Left() > view.Right() || box.Right() < view.Left() ||
+			box.Bottom() > view.Top() || box.Top() < view.Bottom())
+		{
+			continue;
+		}
+
 		if ((!(subsectors[i].flags & SSECF_DRAWN) || (subsectors[i].render_sector->MoreFlags & SECF_HIDDEN)) && am_cheat == 0)
 		{
 			continue;
@@ -2367,151 +2627,180 @@ bool AM_isLockBoundary (line_t &line, int *lockptr = NULL)
 
 //=============================================================================
 //
-// Determines visible lines, draws them.
-// This is LineDef based, not LineSeg based.
+// Draws a single line for portal group pass p of AM_drawWalls.
 //
 //=============================================================================
 
-void AM_drawWalls (bool allmap)
+static void AM_drawWall (line_t &line, int p, int numportalgroups, bool allmap)
 {
-	int i;
 	static mline_t l;
 	int lock, color;
+	int pg;
 
-	int numportalgroups = am_portaloverlay ? Displacements.size : 0;
-
-	for (int p = numportalgroups - 1; p >= -1; p--)
+	if (line.sidedef[0]->Flags & WALLF_POLYOBJ)
 	{
-		if (p == MapPortalGroup) continue;
+		// For polyobjects we must test the surrounding sector to get the proper group.
+		pg = P_PointInSector(line.v1->fX() + line.Delta().X / 2, line.v1->fY() + line.Delta().Y / 2)->PortalGroup;
+	}
+	else
+	{
+		pg = line.frontsector->PortalGroup;
+	}
+	DVector2 offset;
+	bool portalmode = numportalgroups > 0 &&  pg != MapPortalGroup;
+	if (pg == p)
+	{
+		offset = Displacements.getOffset(pg, MapPortalGroup);
+	}
+	else if (p == -1 && (pg == MapPortalGroup || !am_portaloverlay))
+	{
+		offset = { 0, 0 };
+	}
+	else return;
 
+	l.a.x = (line.v1->fX() + offset.X);
+	l.a.y = (line.v1->fY() + offset.Y);
+	l.b.x = (line.v2->fX() + offset.X);
+	l.b.y = (line.v2->fY() + offset.Y);
 
-		for (i = 0; i < numlines; i++)
+	if (am_rotate == 1 || (am_rotate == 2 && viewactive))
+	{
+		AM_rotatePoint(&l.a.x, &l.a.y);
+		AM_rotatePoint(&l.b.x, &l.b.y);
+	}
+
+	if (am_cheat != 0 || (line.flags & ML_MAPPED))
+	{
+		if ((line.flags & ML_DONTDRAW) && (am_cheat == 0 || am_cheat >= 4))
 		{
-			int pg;
-			
-			if (lines[i].sidedef[0]->Flags & WALLF_POLYOBJ)
+			if (!am_showallenabled || CheckCheatmode(false))
 			{
-				// For polyobjects we must test the surrounding sector to get the proper group.
-				pg = P_PointInSector(lines[i].v1->fX() + lines[i].Delta().X / 2, lines[i].v1->fY() + lines[i].Delta().Y / 2)->PortalGroup;
+				return;
 			}
+		}
+
+		if (portalmode)
+		{
+			AM_drawMline(&l, AMColors.PortalColor);
+		}
+		else if (AM_CheckSecret(&line))
+		{
+			// map secret sectors like Boom
+			AM_drawMline(&l, AMColors.SecretSectorColor);
+		}
+		else if (line.flags & ML_SECRET)
+		{ // secret door
+			if (am_cheat != 0 && line.backsector != NULL)
+				AM_drawMline(&l, AMColors.SecretWallColor);
 			else
+				AM_drawMline(&l, AMColors.WallColor);
+		}
+		else if (AM_isTeleportBoundary(line) && AMColors.isValid(AMColors.IntraTeleportColor))
+		{ // intra-level teleporters
+			AM_drawMline(&l, AMColors.IntraTeleportColor);
+		}
+		else if (AM_isExitBoundary(line) && AMColors.isValid(AMColors.InterTeleportColor))
+		{ // inter-level/game-ending teleporters
+			AM_drawMline(&l, AMColors.InterTeleportColor);
+		}
+		else if (AM_isLockBoundary(line, &lock))
+		{
+			if (AMColors.displayLocks)
 			{
-				pg = lines[i].frontsector->PortalGroup;
+				color = P_GetMapColorForLock(lock);
+
+				AMColor c;
+
+				if (color >= 0)	c.FromRGB(RPART(color), GPART(color), BPART(color));
+				else c = AMColors[AMColors.LockedColor];
+
+				AM_drawMline(&l, c);
 			}
-			DVector2 offset;
-			bool portalmode = numportalgroups > 0 &&  pg != MapPortalGroup;
-			if (pg == p)
+			else
 			{
-				offset = Displacements.getOffset(pg, MapPortalGroup);
+				AM_drawMline(&l, AMColors.LockedColor);  // locked special
 			}
-			else if (p == -1 && (pg == MapPortalGroup || !am_portaloverlay))
+		}
+		else if (am_showtriggerlines
+			&& AMColors.isValid(AMColors.SpecialWallColor)
+			&& AM_isTriggerBoundary(line))
+		{
+			AM_drawMline(&l, AMColors.SpecialWallColor);	// wall with special non-door action the player can do
+		}
+		else if (line.backsector == NULL)
+		{
+			AM_drawMline(&l, AMColors.WallColor);	// one-sided wall
+		}
+		else if (line.backsector->floorplane
+			!= line.frontsector->floorplane)
+		{
+			AM_drawMline(&l, AMColors.FDWallColor); // floor level change
+		}
+		else if (line.backsector->ceilingplane
+			!= line.frontsector->ceilingplane)
+		{
+			AM_drawMline(&l, AMColors.CDWallColor); // ceiling level change
+		}
+		else if (AM_Check3DFloors(&line))
+		{
+			AM_drawMline(&l, AMColors.EFWallColor); // Extra floor border
+		}
+		else if (am_cheat > 0 && am_cheat < 4)
+		{
+			AM_drawMline(&l, AMColors.TSWallColor);
+		}
+	}
+	else if (allmap)
+	{
+		if ((line.flags & ML_DONTDRAW) && (am_cheat == 0 || am_cheat >= 4))
+		{
+			if (!am_showallenabled || CheckCheatmode(false))
 			{
-				offset = { 0, 0 };
+				return;
 			}
-			else continue;
-
-			l.a.x = (lines[i].v1->fX() + offset.X);
-			l.a.y = (lines[i].v1->fY() + offset.Y);
-			l.b.x = (lines[i].v2->fX() + offset.X);
-			l.b.y = (lines[i].v2->fY() + offset.Y);
+		}
+		AM_drawMline(&l, AMColors.NotSeenColor);
+	}
+}
 
-			if (am_rotate == 1 || (am_rotate == 2 && viewactive))
-			{
-				AM_rotatePoint(&l.a.x, &l.a.y);
-				AM_rotatePoint(&l.b.x, &l.b.y);
-			}
+//=============================================================================
+//
+// Determines visible lines, draws them.
+// This is LineDef based, not LineSeg based.
+//
+//=============================================================================
 
-			if (am_cheat != 0 || (lines[i].flags & ML_MAPPED))
-			{
-				if ((lines[i].flags & ML_DONTDRAW) && (am_cheat == 0 || am_cheat >= 4))
-				{
-					if (!am_showallenabled || CheckCheatmode(false))
-					{
-						continue;
-					}
-				}
+void AM_drawWalls (bool allmap)
+{
+	int numportalgroups = am_portaloverlay ? Displacements.size : 0;
+	FBoundingBox view;
 
-				if (portalmode)
-				{
-					AM_drawMline(&l, AMColors.PortalColor);
-				}
-				else if (AM_CheckSecret(&lines[i]))
-				{
-					// map secret sectors like Boom
-					AM_drawMline(&l, AMColors.SecretSectorColor);
-				}
-				else if (lines[i].flags & ML_SECRET)
-				{ // secret door
-					if (am_cheat != 0 && lines[i].backsector != NULL)
-						AM_drawMline(&l, AMColors.SecretWallColor);
-					else
-						AM_drawMline(&l, AMColors.WallColor);
-				}
-				else if (AM_isTeleportBoundary(lines[i]) && AMColors.isValid(AMColors.IntraTeleportColor))
-				{ // intra-level teleporters
-					AM_drawMline(&l, AMColors.IntraTeleportColor);
-				}
-				else if (AM_isExitBoundary(lines[i]) && AMColors.isValid(AMColors.InterTeleportColor))
-				{ // inter-level/game-ending teleporters
-					AM_drawMline(&l, AMColors.InterTeleportColor);
-				}
-				else if (AM_isLockBoundary(lines[i], &lock))
-				{
-					if (AMColors.displayLocks)
-					{
-						color = P_GetMapColorForLock(lock);
+	if (!CullGridValid)
+	{
+		AM_buildCullGrid();
+	}
+	AM_getVisibleBox(m_x, m_y, m_x2, m_y2, view);
 
-						AMColor c;
+	for (int p = numportalgroups - 1; p >= -1; p--)
+	{
+		if (p == MapPortalGroup) continue;
 
-						if (color >= 0)	c.FromRGB(RPART(color), GPART(color), BPART(color));
-						else c = AMColors[AMColors.LockedColor];
+		// The lines of this pass are drawn moved by the group's offset, so
+		// move the view the other way to find them.
+		DVector2 offset = p >= 0 ? Displacements.getOffset(p, MapPortalGroup) : DVector2(0, 0);
 
-						AM_drawMline(&l, c);
-					}
-					else
-					{
-						AM_drawMline(&l, AMColors.LockedColor);  // locked special
-					}
-				}
-				else if (am_showtriggerlines
-					&& AMColors.isValid(AMColors.SpecialWallColor)
-					&& AM_isTriggerBoundary(lines[i]))
-				{
-					AM_drawMline(&l, AMColors.SpecialWallColor);	// wall with special non-door action the player can do
-				}
-				else if (lines[i].backsector == NULL)
-				{
-					AM_drawMline(&l, AMColors.WallColor);	// one-sided wall
-				}
-				else if (lines[i].backsector->floorplane
-					!= lines[i].frontsector->floorplane)
-				{
-					AM_drawMline(&l, AMColors.FDWallColor); // floor level change
-				}
-				else if (lines[i].backsector->ceilingplane
-					!= lines[i].frontsector->ceilingplane)
-				{
-					AM_drawMline(&l, AMColors.CDWallColor); // ceiling level change
-				}
-				else if (AM_Check3DFloors(&lines[i]))
-				{
-					AM_drawMline(&l, AMColors.EFWallColor); // Extra floor border
-				}
-				else if (am_cheat > 0 && am_cheat < 4)
-				{
-					AM_drawMline(&l, AMColors.TSWallColor);
-				}
+		if (AM_collectLines(view.Left() - offset.X, view.Bottom() - offset.Y, view.Right() - offset.X, view.Top() - offset.Y))
+		{
+			for (unsigned i = 0; i < CullVisible.Size(); i++)
+			{
+				AM_drawWall(lines[CullVisible[i]], p, numportalgroups, allmap);
 			}
-			else if (allmap)
+		}
+		else
+		{
+			for (int i = 0; i < numlines; i++)
 			{
-				if ((lines[i].flags & ML_DONTDRAW) && (am_cheat == 0 || am_cheat >= 4))
-				{
-					if (!am_showallenabled || CheckCheatmode(false))
-					{
-						continue;
-					}
-				}
-				AM_drawMline(&l, AMColors.NotSeenColor);
+				AM_drawWall(lines[i], p, numportalgroups, allmap);
 			}
 		}
 	}
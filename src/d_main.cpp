@@ -75,6 +75,8 @@
 #include "p_setup.h"
 #include "r_utility.h"
 #include "r_sky.h"
+#include "r_bench.h"
+#include "r_profile.h"
 #include "d_main.h"
 #include "d_dehacked.h"
 #include "cmdlib.h"
@@ -232,6 +234,8 @@ int restart = 0;
 bool batchrun;	// just run the startup and collect all error messages in a logfile, then quit without any interaction
 
 cycle_t FrameCycles;
+static cycle_t TwoDCycles, BlitCycles;
+extern cycle_t DimCycles;
 
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
@@ -651,6 +655,9 @@ void D_Display ()
 	
 	cycles.Reset();
 	cycles.Clock();
+	TwoDCycles.Reset();
+	BlitCycles.Reset();
+	DimCycles.Reset();
 
 	if (players[consoleplayer].camera == NULL)
 	{
@@ -743,7 +750,9 @@ void D_Display ()
 	{
 		unsigned int nowtime = I_FPSTime();
 		TexMan.UpdateAnimations(nowtime);
+		TexMan.TrimCompositeCache();
 		R_UpdateSky(nowtime);
+		TwoDCycles.Clock();
 		switch (gamestate)
 		{
 		case GS_FULLCONSOLE:
@@ -767,7 +776,9 @@ void D_Display ()
 			screen->SetBlendingRect(viewwindowx, viewwindowy,
 				viewwindowx + viewwidth, viewwindowy + viewheight);
 
+			TwoDCycles.Unclock();
 			Renderer->RenderView(&players[consoleplayer]);
+			TwoDCycles.Clock();
 
 			if ((hw2d = screen->Begin2D(viewactive)))
 			{
@@ -888,7 +899,10 @@ void D_Display ()
 		C_DrawConsole (hw2d);	// draw console
 		M_Drawer ();			// menu is drawn even on top of everything
 		FStat::PrintStat ();
+		TwoDCycles.Unclock();
+		BlitCycles.Clock();
 		screen->Update ();		// page flip or blit buffer
+		BlitCycles.Unclock();
 	}
 	else
 	{
@@ -896,6 +910,7 @@ void D_Display ()
 		unsigned int wipestart, nowtime, diff;
 		bool done;
 
+		TwoDCycles.Unclock();
 		GSnd->SetSfxPaused(true, 1);
 		I_FreezeTime(true);
 		screen->WipeEndScreen ();
@@ -926,6 +941,22 @@ void D_Display ()
 
 	cycles.Unclock();
 	FrameCycles = cycles;
+
+	if (R_IsProfiling())
+	{
+		extern cycle_t WallCycles, PlaneCycles, MaskedCycles, SkyBoxCycles;
+		double times[NUM_PROF_STAGES];
+		bool rendered = gamestate == GS_LEVEL || gamestate == GS_TITLELEVEL;
+
+		times[PROF_Frame] = FrameCycles.TimeMS();
+		times[PROF_BSP] = rendered ? WallCycles.TimeMS() : 0;
+		times[PROF_Planes] = rendered ? PlaneCycles.TimeMS() - SkyBoxCycles.TimeMS() : 0;
+		times[PROF_SkyBoxes] = rendered ? SkyBoxCycles.TimeMS() : 0;
+		times[PROF_Masked] = rendered ? MaskedCycles.TimeMS() : 0;
+		times[PROF_2D] = TwoDCycles.TimeMS();
+		times[PROF_Blit] = BlitCycles.TimeMS();
+		R_ProfileFrame(times);
+	}
 }
 
 //==========================================================================
@@ -2572,7 +2603,19 @@ void D_DoomMain (void)
 				throw CNoRunExit();
 			}
 
-			V_Init2();
+			// -benchrender never shows anything, so it does not need a display.
+			if (Args->CheckValue("-benchrender") != NULL)
+			{
+				if (!autostart)
+				{
+					I_FatalError ("-benchrender needs a map to start, e.g. with -warp");
+				}
+				V_InitHeadless();
+			}
+			else
+			{
+				V_Init2();
+			}
 			UpdateJoystickMenu(NULL);
 
 			v = Args->CheckValue ("-loadgame");
@@ -2617,6 +2660,11 @@ void D_DoomMain (void)
 						AddCommandString(StoredWarp.LockBuffer());
 						StoredWarp = NULL;
 					}
+					v = Args->CheckValue("-benchrender");
+					if (v != NULL)
+					{
+						exit(R_BenchRender(v) ? 0 : 1);
+					}
 				}
 				else
 				{
@@ -28,6 +28,7 @@
 #include "f_wipe.h"
 #include "c_cvars.h"
 #include "templates.h"
+#include "stats.h"
 
 //
 //		SCREEN WIPE PACKAGE
@@ -48,6 +49,11 @@ static int burntime;
 
 // [RH] Crossfade
 static int fade;
+static BYTE *fadetable;		// [new<<8|old] for the fade level in fadetablelevel
+static int fadetablelevel;
+
+static cycle_t WipeCycles;
+extern cycle_t DimCycles;
 
 
 // Melt -------------------------------------------------------------
@@ -56,23 +62,6 @@ static int fade;
 #define MELT_WIDTH		160
 #define MELT_HEIGHT		200
 
-void wipe_shittyColMajorXform (short *array)
-{
-	int x, y;
-	short *dest;
-	int width = SCREENWIDTH / 2;
-
-	dest = new short[width*SCREENHEIGHT*2];
-
-	for(y = 0; y < SCREENHEIGHT; y++)
-		for(x = 0; x < width; x++)
-			dest[x*SCREENHEIGHT+y] = array[y*width+x];
-
-	memcpy(array, dest, SCREENWIDTH*SCREENHEIGHT);
-
-	delete[] dest;
-}
-
 bool wipe_initMelt (int ticks)
 {
 	int i, r;
@@ -80,11 +69,6 @@ bool wipe_initMelt (int ticks)
 	// copy start screen to main screen
 	screen->DrawBlock (0, 0, SCREENWIDTH, SCREENHEIGHT, (BYTE *)wipe_scr_start);
 	
-	// makes this wipe faster (in theory)
-	// to have stuff in column-major format
-	wipe_shittyColMajorXform (wipe_scr_start);
-	wipe_shittyColMajorXform (wipe_scr_end);
-	
 	// setup initial column positions
 	// (y<0 => not ready to scroll yet)
 	y = new int[MELT_WIDTH];
@@ -98,11 +82,53 @@ bool wipe_initMelt (int ticks)
 	return 0;
 }
 
+// Draws the screen a row at a time. Neighboring strips that have moved
+// down by the same amount are copied together.
+static void wipe_drawMelt ()
+{
+	struct MeltRun { int x1, x2, top; } runs[MELT_WIDTH];
+	const int width = SCREENWIDTH / 2;
+	const int pitch = screen->GetPitch() / 2;
+	int numruns = 0;
+	int i;
+
+	for (i = 0; i < MELT_WIDTH; i++)
+	{
+		if (y[i] >= 0)
+		{
+			int x1 = i * width / MELT_WIDTH;
+			int x2 = (i + 1) * width / MELT_WIDTH;
+			int top = y[i] * SCREENHEIGHT / MELT_HEIGHT;
+
+			if (numruns > 0 && runs[numruns-1].x2 == x1 && runs[numruns-1].top == top)
+			{
+				runs[numruns-1].x2 = x2;
+			}
+			else
+			{
+				runs[numruns].x1 = x1;
+				runs[numruns].x2 = x2;
+				runs[numruns].top = top;
+				numruns++;
+			}
+		}
+	}
+
+	short *d = (short *)screen->GetBuffer();
+	for (int sy = 0; sy < SCREENHEIGHT; sy++, d += pitch)
+	{
+		for (i = 0; i < numruns; i++)
+		{
+			const MeltRun &run = runs[i];
+			const short *s = sy < run.top ? &wipe_scr_end[sy * width] : &wipe_scr_start[(sy - run.top) * width];
+			memcpy (d + run.x1, s + run.x1, (run.x2 - run.x1) * sizeof(short));
+		}
+	}
+}
+
 bool wipe_doMelt (int ticks)
 {
-	int i, j, dy, x;
-	const short *s;
-	short *d;
+	int i, dy;
 	bool done = true;
 
 	while (ticks--)
@@ -121,31 +147,10 @@ bool wipe_doMelt (int ticks)
 				y[i] = MIN(y[i] + dy, MELT_HEIGHT);
 				done = false;
 			}
-			if (ticks == 0 && y[i] >= 0)
-			{ // Only draw for the final tick.
-				const int pitch = screen->GetPitch() / 2;
-				int sy = y[i] * SCREENHEIGHT / MELT_HEIGHT;
-
-				for (x = i * (SCREENWIDTH/2) / MELT_WIDTH; x < (i + 1) * (SCREENWIDTH/2) / MELT_WIDTH; ++x)
-				{
-					s = &wipe_scr_end[x*SCREENHEIGHT];
-					d = &((short *)screen->GetBuffer())[x];
-
-					for (j = sy; j != 0; --j)
-					{
-						*d = *(s++);
-						d += pitch;
-					}
-
-					s = &wipe_scr_start[x*SCREENHEIGHT];
-
-					for (j = SCREENHEIGHT - sy; j != 0; --j)
-					{
-						*d = *(s++);
-						d += pitch;
-					}
-				}
-			}
+		}
+		if (ticks == 0)
+		{ // Only draw for the final tick.
+			wipe_drawMelt ();
 		}
 	}
 
@@ -268,9 +273,12 @@ bool wipe_doBurn (int ticks)
 		done = (density < 0);
 	}
 
-	// Draw the screen
-	int xstep, ystep, firex, firey;
-	int x, y;
+	// Draw the screen. Every fire cell covers a run of pixels on each row
+	// that is either copied from one of the screens or blended at a
+	// single level.
+	int xstep, ystep, firey;
+	int x, y, fx;
+	int cellstart[FIREWIDTH + 1];
 	BYTE *to, *fromold, *fromnew;
 	const int SHIFT = 16;
 
@@ -280,20 +288,37 @@ bool wipe_doBurn (int ticks)
 	fromold = (BYTE *)wipe_scr_start;
 	fromnew = (BYTE *)wipe_scr_end;
 
+	for (fx = 0, x = 0; fx < FIREWIDTH; fx++)
+	{
+		while (x < SCREENWIDTH && ((x * xstep) >> SHIFT) < fx)
+		{
+			x++;
+		}
+		cellstart[fx] = x;
+	}
+	cellstart[FIREWIDTH] = SCREENWIDTH;
+
 	for (y = 0, firey = 0; y < SCREENHEIGHT; y++, firey += ystep)
 	{
-		for (x = 0, firex = 0; x < SCREENWIDTH; x++, firex += xstep)
+		const BYTE *firerow = &burnarray[(firey>>SHIFT)*FIREWIDTH];
+
+		for (fx = 0; fx < FIREWIDTH; fx++)
 		{
+			int x1 = cellstart[fx], x2 = cellstart[fx + 1];
 			int fglevel;
 
-			fglevel = burnarray[(firex>>SHIFT)+(firey>>SHIFT)*FIREWIDTH] / 2;
+			if (x1 == x2)
+			{
+				continue;
+			}
+			fglevel = firerow[fx] / 2;
 			if (fglevel >= 63)
 			{
-				to[x] = fromnew[x];
+				memcpy (to + x1, fromnew + x1, x2 - x1);
 			}
 			else if (fglevel == 0)
 			{
-				to[x] = fromold[x];
+				memcpy (to + x1, fromold + x1, x2 - x1);
 				done = false;
 			}
 			else
@@ -301,10 +326,13 @@ bool wipe_doBurn (int ticks)
 				int bglevel = 64-fglevel;
 				DWORD *fg2rgb = Col2RGB8[fglevel];
 				DWORD *bg2rgb = Col2RGB8[bglevel];
-				DWORD fg = fg2rgb[fromnew[x]];
-				DWORD bg = bg2rgb[fromold[x]];
-				fg = (fg+bg) | 0x1f07c1f;
-				to[x] = RGB32k.All[fg & (fg>>15)];
+				for (x = x1; x < x2; x++)
+				{
+					DWORD fg = fg2rgb[fromnew[x]];
+					DWORD bg = bg2rgb[fromold[x]];
+					fg = (fg+bg) | 0x1f07c1f;
+					to[x] = RGB32k.All[fg & (fg>>15)];
+				}
 				done = false;
 			}
 		}
@@ -327,6 +355,8 @@ bool wipe_exitBurn (int ticks)
 bool wipe_initFade (int ticks)
 {
 	fade = 0;
+	fadetable = new BYTE[256*256];
+	fadetablelevel = -1;
 	return 0;
 }
 
@@ -341,21 +371,35 @@ bool wipe_doFade (int ticks)
 	else
 	{
 		int x, y;
-		int bglevel = 64 - fade;
-		DWORD *fg2rgb = Col2RGB8[fade];
-		DWORD *bg2rgb = Col2RGB8[bglevel];
 		BYTE *fromnew = (BYTE *)wipe_scr_end;
 		BYTE *fromold = (BYTE *)wipe_scr_start;
 		BYTE *to = screen->GetBuffer();
 
+		// Every pair of colors blends the same way for the whole screen.
+		if (fadetablelevel != fade)
+		{
+			int bglevel = 64 - fade;
+			DWORD *fg2rgb = Col2RGB8[fade];
+			DWORD *bg2rgb = Col2RGB8[bglevel];
+
+			for (x = 0; x < 256; x++)
+			{
+				BYTE *row = &fadetable[x << 8];
+				DWORD fgx = fg2rgb[x];
+				for (y = 0; y < 256; y++)
+				{
+					DWORD fg = (fgx+bg2rgb[y]) | 0x1f07c1f;
+					row[y] = RGB32k.All[fg & (fg>>15)];
+				}
+			}
+			fadetablelevel = fade;
+		}
+
 		for (y = 0; y < SCREENHEIGHT; y++)
 		{
 			for (x = 0; x < SCREENWIDTH; x++)
 			{
-				DWORD fg = fg2rgb[fromnew[x]];
-				DWORD bg = bg2rgb[fromold[x]];
-				fg = (fg+bg) | 0x1f07c1f;
-				to[x] = RGB32k.All[fg & (fg>>15)];
+				to[x] = fadetable[(fromnew[x] << 8) | fromold[x]];
 			}
 			fromnew += SCREENWIDTH;
 			fromold += SCREENWIDTH;
@@ -367,6 +411,8 @@ bool wipe_doFade (int ticks)
 
 bool wipe_exitFade (int ticks)
 {
+	delete[] fadetable;
+	fadetable = NULL;
 	return 0;
 }
 
@@ -415,7 +461,10 @@ bool wipe_ScreenWipe (int ticks)
 
 	// do a piece of wipe-in
 	V_MarkRect(0, 0, SCREENWIDTH, SCREENHEIGHT);
+	WipeCycles.Reset();
+	WipeCycles.Clock();
 	rc = (*wipes[(CurrentWipeType-1)*3+1])(ticks);
+	WipeCycles.Unclock();
 
 	return rc;
 }
@@ -438,3 +487,11 @@ void wipe_Cleanup()
 		(*wipes[(CurrentWipeType-1)*3+2])(0);
 	}
 }
+
+ADD_STAT (wipe)
+{
+	FString out;
+	out.Format ("wipe=%04.1f ms  dim=%04.1f ms",
+		WipeCycles.TimeMS(), DimCycles.TimeMS());
+	return out;
+}
@@ -348,6 +348,7 @@ public:
 	DHUDMessage *DetachMessage (DHUDMessage *msg);
 	DHUDMessage *DetachMessage (uint32 id);
 	void DetachAllMessages ();
+	bool HasMessages ();
 	void ShowPlayerName ();
 	double GetDisplacement() { return Displacement; }
 	int GetPlayer ();
@@ -57,6 +57,9 @@
 #include "p_acs.h"
 #include "gstrings.h"
 #include "version.h"
+#include "m_crc32.h"
+#include "c_console.h"
+#include "hu_stuff.h"
 
 #define ARTIFLASH_OFFSET (statusBar->invBarOffset+6)
 enum
@@ -75,6 +78,9 @@ EXTERN_CVAR(Int, screenblocks)
 EXTERN_CVAR(Bool, vid_fps)
 EXTERN_CVAR(Bool, hud_scale)
 
+// Skip drawing the status bar when it would look the same as last frame.
+CVAR(Bool, st_cache, false, CVAR_ARCHIVE)
+
 class DSBarInfo;
 static double nulclip[] = { 0,0,0,0 };
 
@@ -978,7 +984,8 @@ public:
 	DSBarInfo (SBarInfo *script=NULL) : DBaseStatusBar(script->height, script->resW, script->resH),
 		ammo1(NULL), ammo2(NULL), ammocount1(0), ammocount2(0), armor(NULL),
 		pendingPopup(POP_None), currentPopup(POP_None), lastHud(-1),
-		scalingWasForced(false), lastInventoryBar(NULL), lastPopup(NULL)
+		scalingWasForced(false), lastInventoryBar(NULL), lastPopup(NULL),
+		hashOnly(false), drawHash(0), drawTop(0), lastDrawHash(0), drawnPages(0), drawCount(0)
 	{
 		this->script = script;
 
@@ -1018,7 +1025,13 @@ public:
 
 	void Draw (EHudState state)
 	{
+		bool refresh = SB_state != 0 || BorderNeedRefresh;
+
 		DBaseStatusBar::Draw(state);
+		if (st_cache && state == HUD_StatusBar && SB_state != 0)
+		{
+			SB_state--;
+		}
 		if (script->cleanX <= 0)
 		{ // Calculate cleanX and cleanY
 			ScreenSizeChanged();
@@ -1077,8 +1090,13 @@ public:
 
 			if(currentPopup != POP_None && !script->huds[hud]->FullScreenOffsets())
 				script->huds[hud]->Draw(NULL, this, script->popups[currentPopup-1].getXDisplacement(), script->popups[currentPopup-1].getYDisplacement(), 1.);
-			else
+			else if(!CanCacheBar(state, hud))
+			{
+				drawnPages = 0;
 				script->huds[hud]->Draw(NULL, this, 0, 0, 1.);
+			}
+			else
+				DrawCachedBar(hud, refresh);
 			lastHud = hud;
 
 			// Handle inventory bar drawing
@@ -1121,6 +1139,97 @@ public:
 		hud_scale = oldhud_scale;
 	}
 
+	//----------------------------------------------------------------------
+	//
+	// Status bar cache
+	//
+	// In software mode nothing else draws over a normal status bar, so its
+	// pixels from the last frame are still on the screen. To find out if
+	// the bar changed, the command tree is first run with hashOnly set,
+	// which turns DrawGraphic and DrawString into a CRC of everything they
+	// would have drawn. The bar is only really drawn if that CRC changed,
+	// if something asked for a refresh, or if not every page of the screen
+	// has the current bar yet.
+	//
+	//----------------------------------------------------------------------
+
+	bool CanCacheBar(EHudState state, int hud)
+	{
+		if(!st_cache || state != HUD_StatusBar || script->huds[hud]->FullScreenOffsets())
+			return false;
+		// These all draw over the status bar.
+		return currentPopup == POP_None && CPlayer->inventorytics <= 0 && !HasMessages() &&
+			menuactive == MENU_Off && ConsoleState == c_up && !chatmodeon;
+	}
+
+	void DrawCachedBar(int hud, bool refresh)
+	{
+		drawCount++;
+		hashOnly = true;
+		drawHash = 0;
+		HashValue(hud);
+		HashValue(ST_X);
+		HashValue(::ST_Y);
+		HashValue(Scaled);
+		script->huds[hud]->Draw(NULL, this, 0, 0, 1.);
+		hashOnly = false;
+
+		// Everything must have been drawn below the 3D view and the automap,
+		// or they will have been drawn over it.
+		if(!refresh && drawnPages >= screen->GetPageCount() && drawHash == lastDrawHash &&
+			drawTop + 0.5 >= MAX(viewwindowy + viewheight, ::ST_Y))
+		{
+			return;
+		}
+
+		// The new bar need not cover everything the old one drew, so the
+		// background under it has to be redrawn, on every page.
+		if(!refresh && drawHash != lastDrawHash)
+		{
+			ST_SetNeedRefresh();
+			RefreshBackground();
+		}
+		drawnPages = drawHash == lastDrawHash ? drawnPages + 1 : 1;
+		lastDrawHash = drawHash;
+		drawTop = SCREENHEIGHT;
+		script->huds[hud]->Draw(NULL, this, 0, 0, 1.);
+	}
+
+	template<class T> void HashValue(const T &value) const
+	{
+		drawHash = AddCRC32(drawHash, (const BYTE *)&value, sizeof(value));
+	}
+
+	void HashGraphic(FTexture* texture, SBarInfoCoordinate x, SBarInfoCoordinate y, int xOffset, int yOffset, double Alpha, bool fullScreenOffsets, bool translate, bool dim, int offsetflags, bool alphaMap, int forceWidth, int forceHeight, const double *clip, bool clearDontDraw) const
+	{
+		HashValue(texture);
+		// Warped and camera textures change without the texture changing,
+		// so the bar must be redrawn every frame while they are on it.
+		if(texture->bWarped || texture->bHasCanvas)
+			HashValue(drawCount);
+		HashValue(fullScreenOffsets);
+		HashValue(*x);
+		HashValue(*y);
+		HashValue(xOffset);
+		HashValue(yOffset);
+		HashValue(Alpha);
+		HashValue(translate);
+		HashValue(dim);
+		HashValue(offsetflags);
+		HashValue(alphaMap);
+		HashValue(forceWidth);
+		HashValue(forceHeight);
+		HashValue(clearDontDraw);
+		for(int i = 0;i < 4;i++)
+			HashValue(clip[i]);
+		if(translate)
+		{
+			FRemapTable *remap = GetTranslation();
+			if(remap != NULL)
+				drawHash = AddCRC32(drawHash, remap->Remap, remap->NumEntries);
+		}
+	}
+
 	void NewGame ()
 	{
 		if (CPlayer != NULL)
@@ -1201,6 +1310,12 @@ public:
 		if (texture == NULL)
 			return;
 
+		if (hashOnly)
+		{
+			HashGraphic(texture, x, y, xOffset, yOffset, Alpha, fullScreenOffsets, translate, dim, offsetflags, alphaMap, forceWidth, forceHeight, clip, clearDontDraw);
+			return;
+		}
+
 		double dx = *x;
 		double dy = *y;
 
@@ -1247,49 +1362,21 @@ public:
 				dcy += 200 - script->resH;
 				dcb += 200 - script->resH;
 			}
+			drawTop = MIN(drawTop, MAX(MIN(dy - h, dy - texture->GetScaledTopOffsetDouble() * h / texture->GetScaledHeightDouble()), dcy));
 
 			if(clearDontDraw)
 				screen->Clear(static_cast<int>(MAX<double>(dx, dcx)), static_cast<int>(MAX<double>(dy, dcy)), static_cast<int>(MIN<double>(dcr,w+MAX<double>(dx, dcx))), static_cast<int>(MIN<double>(dcb,MAX<double>(dy, dcy)+h)), GPalette.BlackIndex, 0);
 			else
 			{
-				if(alphaMap)
-				{
-					screen->DrawTexture(texture, dx, dy,
-						DTA_DestWidthF, w,
-						DTA_DestHeightF, h,
-						DTA_ClipLeft, static_cast<int>(dcx),
-						DTA_ClipTop, static_cast<int>(dcy),
-						DTA_ClipRight, static_cast<int>(MIN<double>(INT_MAX, dcr)),
-						DTA_ClipBottom, static_cast<int>(MIN<double>(INT_MAX, dcb)),
-						DTA_Translation, translate ? GetTranslation() : 0,
-						DTA_ColorOverlay, dim ? DIM_OVERLAY : 0,
-						DTA_CenterBottomOffset, (offsetflags & SBarInfoCommand::CENTER_BOTTOM) == SBarInfoCommand::CENTER_BOTTOM,
-						DTA_AlphaF, Alpha,
-						DTA_AlphaChannel, alphaMap,
-						DTA_FillColor, 0,
-						TAG_DONE);
-				}
-				else
-				{
-					screen->DrawTexture(texture, dx, dy,
-						DTA_DestWidthF, w,
-						DTA_DestHeightF, h,
-						DTA_ClipLeft, static_cast<int>(dcx),
-						DTA_ClipTop, static_cast<int>(dcy),
-						DTA_ClipRight, static_cast<int>(MIN<double>(INT_MAX, dcr)),
-						DTA_ClipBottom, static_cast<int>(MIN<double>(INT_MAX, dcb)),
-						DTA_Translation, translate ? GetTranslation() : 0,
-						DTA_ColorOverlay, dim ? DIM_OVERLAY : 0,
-						DTA_CenterBottomOffset, (offsetflags & SBarInfoCommand::CENTER_BOTTOM) == SBarInfoCommand::CENTER_BOTTOM,
-						DTA_AlphaF, Alpha,
-						TAG_DONE);
-				}
+				DrawGraphicImage(texture, dx, dy, w, h, static_cast<int>(dcx), static_cast<int>(dcy), static_cast<int>(MIN<double>(INT_MAX, dcr)), static_cast<int>(MIN<double>(INT_MAX, dcb)), translate, dim, offsetflags, Alpha, alphaMap);
 			}
 		}
 		else
 		{
 			double rx, ry, rcx=0, rcy=0, rcr=INT_MAX, rcb=INT_MAX;
 
+			drawTop = -1;		// Can be anywhere on the screen
+
 			double xScale = !hud_scale ? 1 : script->cleanX;
 			double yScale = !hud_scale ? 1 : script->cleanY;
 
@@ -1329,44 +1416,64 @@ public:
 				screen->Clear(static_cast<int>(rcx), static_cast<int>(rcy), static_cast<int>(MIN<double>(rcr, rcx+w)), static_cast<int>(MIN<double>(rcb, rcy+h)), GPalette.BlackIndex, 0);
 			else
 			{
-				if(alphaMap)
-				{
-					screen->DrawTexture(texture, rx, ry,
-						DTA_DestWidthF, w,
-						DTA_DestHeightF, h,
-						DTA_ClipLeft, static_cast<int>(rcx),
-						DTA_ClipTop, static_cast<int>(rcy),
-						DTA_ClipRight, static_cast<int>(rcr),
-						DTA_ClipBottom, static_cast<int>(rcb),
-						DTA_Translation, translate ? GetTranslation() : 0,
-						DTA_ColorOverlay, dim ? DIM_OVERLAY : 0,
-						DTA_CenterBottomOffset, (offsetflags & SBarInfoCommand::CENTER_BOTTOM) == SBarInfoCommand::CENTER_BOTTOM,
-						DTA_AlphaF, Alpha,
-						DTA_AlphaChannel, alphaMap,
-						DTA_FillColor, 0,
-						TAG_DONE);
-				}
-				else
-				{
-					screen->DrawTexture(texture, rx, ry,
-						DTA_DestWidthF, w,
-						DTA_DestHeightF, h,
-						DTA_ClipLeft, static_cast<int>(rcx),
-						DTA_ClipTop, static_cast<int>(rcy),
-						DTA_ClipRight, static_cast<int>(rcr),
-						DTA_ClipBottom, static_cast<int>(rcb),
-						DTA_Translation, translate ? GetTranslation() : 0,
-						DTA_ColorOverlay, dim ? DIM_OVERLAY : 0,
-						DTA_CenterBottomOffset, (offsetflags & SBarInfoCommand::CENTER_BOTTOM) == SBarInfoCommand::CENTER_BOTTOM,
-						DTA_AlphaF, Alpha,
-						TAG_DONE);
-				}
+				DrawGraphicImage(texture, rx, ry, w, h, static_cast<int>(rcx), static_cast<int>(rcy), static_cast<int>(rcr), static_cast<int>(rcb), translate, dim, offsetflags, Alpha, alphaMap);
 			}
 		}
 	}
 
+	// DrawTexture with the tags DrawGraphic uses, filled in directly.
+	void DrawGraphicImage(FTexture *texture, double x, double y, double w, double h, int clipleft, int cliptop, int clipright, int clipbottom, bool translate, bool dim, int offsetflags, double Alpha, bool alphaMap) const
+	{
+		DrawParms parms;
+
+		if (!screen->InitDrawParms(texture, x, y, &parms))
+			return;
+
+		parms.destwidth = w;
+		parms.destheight = h;
+		parms.lclip = MAX(clipleft, 0);
+		parms.uclip = MAX(cliptop, 0);
+		parms.rclip = MIN(clipright, screen->GetWidth());
+		parms.dclip = MIN(clipbottom, screen->GetHeight());
+		parms.remap = translate ? GetTranslation() : NULL;
+		if (parms.remap != NULL && parms.remap->Inactive)
+			parms.remap = NULL;
+		parms.colorOverlay = dim ? DIM_OVERLAY : 0;
+		if ((offsetflags & SBarInfoCommand::CENTER_BOTTOM) == SBarInfoCommand::CENTER_BOTTOM)
+		{
+			parms.left = parms.texwidth * 0.5;
+			parms.top = parms.texheight;
+		}
+		parms.Alpha = (float)MIN(1., Alpha);
+		if (alphaMap)
+		{
+			parms.alphaChannel = true;
+			parms.fillcolor = 0;
+			parms.fillcolorset = true;
+		}
+		screen->DrawTexture(texture, parms);
+	}
+
 	void DrawString(FFont *font, const char* cstring, SBarInfoCoordinate x, SBarInfoCoordinate y, int xOffset, int yOffset, double Alpha, bool fullScreenOffsets, EColorRange translation, int spacing=0, bool drawshadow=false, int shadowX=2, int shadowY=2) const
 	{
+		if(hashOnly)
+		{
+			HashValue(font);
+			HashValue(fullScreenOffsets);
+			HashValue(*x);
+			HashValue(*y);
+			HashValue(xOffset);
+			HashValue(yOffset);
+			HashValue(Alpha);
+			HashValue(translation);
+			HashValue(spacing);
+			HashValue(drawshadow);
+			HashValue(shadowX);
+			HashValue(shadowY);
+			drawHash = AddCRC32(drawHash, (const BYTE *)cstring, (unsigned)strlen(cstring));
+			return;
+		}
+
 		x += spacing;
 		double ax = *x;
 		double ay = *y;
@@ -1452,9 +1559,11 @@ public:
 				{
 					ry += (200 - script->resH);
 				}
+				drawTop = MIN(drawTop, MIN(ry, ry - character->GetScaledTopOffsetDouble() * rh / character->GetScaledHeightDouble()));
 			}
 			else
 			{
+				drawTop = -1;
 				if(vid_fps && ax < 0 && ay >= 0)
 					ry += 10;
 
@@ -1520,6 +1629,14 @@ private:
 	bool scalingWasForced;
 	SBarInfoMainBlock *lastInventoryBar;
 	SBarInfoMainBlock *lastPopup;
+
+	// Status bar cache
+	mutable bool hashOnly;
+	mutable DWORD drawHash;
+	mutable double drawTop;		// Highest row drawn to, in screen coordinates
+	DWORD lastDrawHash;
+	int drawnPages;				// Frames in a row that drew lastDrawHash
+	unsigned int drawCount;		// Hashed for graphics that change by themselves
 };
 
 IMPLEMENT_POINTY_CLASS(DSBarInfo)
@@ -510,6 +510,24 @@ void DBaseStatusBar::DetachAllMessages ()
 	}
 }
 
+//---------------------------------------------------------------------------
+//
+// FUNC HasMessages
+//
+//---------------------------------------------------------------------------
+
+bool DBaseStatusBar::HasMessages ()
+{
+	for (size_t i = 0; i < countof(Messages); ++i)
+	{
+		if (Messages[i] != NULL)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 //---------------------------------------------------------------------------
 //
 // PROC ShowPlayerName
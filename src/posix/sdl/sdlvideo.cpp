@@ -496,9 +496,8 @@ void SDLFB::Update ()
 
 	if (NotPaletted)
 	{
-		GPfx.Convert (MemBuffer, Pitch,
-			pixels, pitch, Width, Height,
-			FRACUNIT, FRACUNIT, 0, 0);
+		GPfx.ConvertSliced (MemBuffer, Pitch,
+			pixels, pitch, Width, Height);
 	}
 	else
 	{
@@ -0,0 +1,457 @@
+/*
+** r_bench.cpp
+** Offscreen render benchmark
+**
+** Renders the current level from a fixed set of viewpoints into an
+** offscreen canvas and writes the per-frame timings of each renderer stage
+** to a CSV or JSON file. The viewpoints are every player and deathmatch
+** start, each looking in eight directions, so the same map always produces
+** the same list. Each frame can also be hashed so that changes to the
+** rendered output show up next to changes in speed.
+**
+** This can be started from the console with "benchrender" or from the
+** command line with "-benchrender <file>" together with -warp, in which
+** case the game runs without a display, renders at the size given with
+** -width and -height, and quits as soon as the benchmark is done.
+**
+** "benchwallprep" is a smaller benchmark for the per-column wall setup
+** only. It records the walls of the current view and replays them
+** through the C and the SSE2 versions.
+**
+*/
+
+#include <stdio.h>
+
+#include "templates.h"
+#include "doomtype.h"
+#include "doomstat.h"
+#include "c_dispatch.h"
+#include "c_cvars.h"
+#include "m_crc32.h"
+#include "d_player.h"
+#include "g_level.h"
+#include "doomdata.h"
+#include "r_local.h"
+#include "r_utility.h"
+#include "v_video.h"
+#include "stats.h"
+#include "r_bench.h"
+#include "r_bsp.h"
+#include "r_segs.h"
+#include "x86.h"
+
+CVAR (Int, r_benchframes, 10, CVAR_ARCHIVE)
+CVAR (Bool, r_benchhash, true, CVAR_ARCHIVE)
+EXTERN_CVAR (Int, r_rendermode)
+
+extern cycle_t WallCycles, PlaneCycles, MaskedCycles;
+
+struct FBenchFrame
+{
+	int View;
+	int Angle;
+	int Frame;
+	double Total, Walls, Planes, Masked;
+	DWORD Hash;
+};
+
+//==========================================================================
+//
+// GetBenchViewpoints
+//
+//==========================================================================
+
+static void GetBenchViewpoints (TArray<DVector3> &points)
+{
+	for (int i = 0; i < MAXPLAYERS; ++i)
+	{
+		if (playerstarts[i].type != 0)
+		{
+			points.Push (playerstarts[i].pos);
+		}
+	}
+	for (unsigned i = 0; i < deathmatchstarts.Size(); ++i)
+	{
+		points.Push (deathmatchstarts[i].pos);
+	}
+	if (points.Size() == 0 && players[consoleplayer].mo != NULL)
+	{
+		points.Push (players[consoleplayer].mo->Pos());
+	}
+}
+
+//==========================================================================
+//
+// HashCanvas
+//
+//==========================================================================
+
+static DWORD HashCanvas (DCanvas *canvas)
+{
+	int bpp = canvas->IsBgra() ? 4 : 1;
+	const BYTE *buffer = canvas->GetBuffer();
+	int width = canvas->GetWidth() * bpp;
+	int pitch = canvas->GetPitch() * bpp;
+	DWORD crc = 0;
+
+	for (int y = canvas->GetHeight(); y > 0; --y, buffer += pitch)
+	{
+		crc = AddCRC32 (crc, buffer, width);
+	}
+	return crc;
+}
+
+//==========================================================================
+//
+// WriteBenchResults
+//
+//==========================================================================
+
+static bool WriteBenchResults (const char *filename, const TArray<FBenchFrame> &frames, int width, int height)
+{
+	FILE *f = fopen (filename, "w");
+	if (f == NULL)
+	{
+		Printf ("Could not open %s for writing\n", filename);
+		return false;
+	}
+
+	size_t len = strlen (filename);
+	bool json = len > 5 && stricmp (filename + len - 5, ".json") == 0;
+
+	if (json)
+	{
+		fprintf (f, "{\n\t\"map\": \"%s\",\n\t\"width\": %d,\n\t\"height\": %d,\n\t\"rendermode\": %d,\n\t\"frames\": [\n",
+			level.MapName.GetChars(), width, height, *r_rendermode);
+		for (unsigned i = 0; i < frames.Size(); ++i)
+		{
+			const FBenchFrame &fr = frames[i];
+			fprintf (f, "\t\t{ \"view\": %d, \"angle\": %d, \"frame\": %d, \"total\": %.4f, \"walls\": %.4f, \"planes\": %.4f, \"masked\": %.4f",
+				fr.View, fr.Angle, fr.Frame, fr.Total, fr.Walls, fr.Planes, fr.Masked);
+			if (r_benchhash)
+			{
+				fprintf (f, ", \"hash\": \"%08x\"", fr.Hash);
+			}
+			fprintf (f, " }%s\n", i + 1 < frames.Size() ? "," : "");
+		}
+		fprintf (f, "\t]\n}\n");
+	}
+	else
+	{
+		fprintf (f, "view,angle,frame,total_ms,walls_ms,planes_ms,masked_ms%s\n", r_benchhash ? ",hash" : "");
+		for (unsigned i = 0; i < frames.Size(); ++i)
+		{
+			const FBenchFrame &fr = frames[i];
+			fprintf (f, "%d,%d,%d,%.4f,%.4f,%.4f,%.4f",
+				fr.View, fr.Angle, fr.Frame, fr.Total, fr.Walls, fr.Planes, fr.Masked);
+			if (r_benchhash)
+			{
+				fprintf (f, ",%08x", fr.Hash);
+			}
+			fprintf (f, "\n");
+		}
+	}
+	fclose (f);
+	return true;
+}
+
+//==========================================================================
+//
+// R_BenchRender
+//
+// Returns false if nothing could be rendered.
+//
+//==========================================================================
+
+bool R_BenchRender (const char *filename, int width, int height)
+{
+	if (gamestate != GS_LEVEL)
+	{
+		Printf ("benchrender needs a level to be loaded\n");
+		return false;
+	}
+
+	TArray<DVector3> points;
+	GetBenchViewpoints (points);
+	if (points.Size() == 0)
+	{
+		Printf ("benchrender: this level has no viewpoints\n");
+		return false;
+	}
+
+	if (width <= 0 || height <= 0)
+	{
+		width = screen->GetWidth();
+		height = screen->GetHeight();
+	}
+	int numframes = MAX<int> (1, r_benchframes);
+	double eyeheight = players[consoleplayer].mo != NULL ? players[consoleplayer].viewheight : 41;
+
+	DSimpleCanvas *canvas = new DSimpleCanvas (width, height, r_rendermode == 1);
+	canvas->ObjectFlags |= OF_Fixed;
+
+	// Interpolation would make the result depend on the wall clock.
+	bool savednointerpolate = r_NoInterpolate;
+	r_NoInterpolate = true;
+
+	TArray<FBenchFrame> frames;
+	cycle_t total;
+
+	for (unsigned v = 0; v < points.Size(); ++v)
+	{
+		DVector3 pos = points[v];
+		pos.Z = P_PointInSector (pos.XY())->floorplane.ZatPoint (pos) + eyeheight;
+
+		AActor *cam = Spawn (NAME_MapSpot, pos, NO_REPLACE);
+		cam->SetZ (pos.Z - cam->GetCameraHeight());
+
+		for (int a = 0; a < 8; ++a)
+		{
+			cam->Angles.Yaw = a * 45.;
+			for (int i = 0; i < numframes; ++i)
+			{
+				FBenchFrame fr;
+
+				canvas->Lock ();
+				total.Reset ();
+				total.Clock ();
+				R_RenderViewToCanvas (cam, canvas, 0, 0, width, height);
+				total.Unclock ();
+
+				fr.View = v;
+				fr.Angle = a * 45;
+				fr.Frame = i;
+				fr.Total = total.TimeMS();
+				fr.Walls = WallCycles.TimeMS();
+				fr.Planes = PlaneCycles.TimeMS();
+				fr.Masked = MaskedCycles.TimeMS();
+				fr.Hash = r_benchhash ? HashCanvas (canvas) : 0;
+				canvas->Unlock ();
+				frames.Push (fr);
+			}
+		}
+		cam->Destroy ();
+	}
+
+	r_NoInterpolate = savednointerpolate;
+	canvas->Destroy ();
+	canvas->ObjectFlags |= OF_YesReallyDelete;
+	delete canvas;
+
+	double sum[4] = { 0, 0, 0, 0 };
+	for (unsigned i = 0; i < frames.Size(); ++i)
+	{
+		sum[0] += frames[i].Total;
+		sum[1] += frames[i].Walls;
+		sum[2] += frames[i].Planes;
+		sum[3] += frames[i].Masked;
+	}
+	int n = frames.Size();
+	Printf ("benchrender: %d frames at %dx%d, avg total=%.3f ms  walls=%.3f ms  planes=%.3f ms  masked=%.3f ms\n",
+		n, width, height, sum[0] / n, sum[1] / n, sum[2] / n, sum[3] / n);
+
+	return WriteBenchResults (filename, frames, width, height);
+}
+
+//==========================================================================
+//
+// CCMD benchrender
+//
+// benchrender <file> [width height]
+//
+//==========================================================================
+
+CCMD (benchrender)
+{
+	if (argv.argc() < 2)
+	{
+		Printf ("Usage: benchrender <file.csv|file.json> [width height]\n");
+		return;
+	}
+	int width = 0, height = 0;
+	if (argv.argc() >= 4)
+	{
+		width = atoi (argv[2]);
+		height = atoi (argv[3]);
+	}
+	R_BenchRender (argv[1], width, height);
+}
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__i386__) || defined(__amd64__)
+
+//==========================================================================
+//
+// ReplayWallPrep
+//
+// Runs every recorded call of one type reps times and returns the time
+// in milliseconds. The results end up in the buffers.
+//
+//==========================================================================
+
+static fixed_t BenchSwall[MAXWIDTH], BenchLwall[MAXWIDTH];
+static short BenchMost[MAXWIDTH];
+
+static void ReplayWallPrepCall (const FWallPrepCall &call, bool sse2)
+{
+	WallT = call.WallT;
+	centerx = call.CenterX;
+	WallTMapScale2 = call.TMapScale2;
+
+	switch (call.Type)
+	{
+	case FWallPrepCall::Wall:
+		if (sse2) PrepWall_SSE2 (BenchSwall, BenchLwall, call.WalXRepeat, call.x1, call.x2);
+		else PrepWall_C (BenchSwall, BenchLwall, call.WalXRepeat, call.x1, call.x2);
+		break;
+
+	case FWallPrepCall::LWall:
+		if (sse2) PrepLWall_SSE2 (BenchLwall, call.WalXRepeat, call.x1, call.x2);
+		else PrepLWall_C (BenchLwall, call.WalXRepeat, call.x1, call.x2);
+		break;
+
+	case FWallPrepCall::Most:
+		if (sse2) InterpolateMost_SSE2 (BenchMost, call.x2, call.Val, call.Delta);
+		else qinterpolatedown16short (BenchMost, call.x2, call.Val, call.Delta);
+		break;
+	}
+}
+
+static double ReplayWallPrep (const TArray<FWallPrepCall> &calls, int type, bool sse2, int reps)
+{
+	cycle_t time;
+
+	time.Reset();
+	time.Clock();
+	for (int r = 0; r < reps; ++r)
+	{
+		for (unsigned i = 0; i < calls.Size(); ++i)
+		{
+			if (calls[i].Type == type)
+			{
+				ReplayWallPrepCall (calls[i], sse2);
+			}
+		}
+	}
+	time.Unclock();
+	return time.TimeMS();
+}
+
+#ifdef SSE2_WALLPREP
+//==========================================================================
+//
+// CompareWallPrep
+//
+// Returns the number of calls whose results differ between the versions.
+//
+//==========================================================================
+
+static int CompareWallPrep (const TArray<FWallPrepCall> &calls, int type)
+{
+	static fixed_t swall[MAXWIDTH], lwall[MAXWIDTH];
+	static short most[MAXWIDTH];
+	int bad = 0;
+
+	for (unsigned i = 0; i < calls.Size(); ++i)
+	{
+		const FWallPrepCall &call = calls[i];
+		if (call.Type != type)
+		{
+			continue;
+		}
+		int x1 = type == FWallPrepCall::Most ? 0 : call.x1;
+		int x2 = call.x2;
+
+		ReplayWallPrepCall (call, false);
+		memcpy (swall, BenchSwall, sizeof(swall));
+		memcpy (lwall, BenchLwall, sizeof(lwall));
+		memcpy (most, BenchMost, sizeof(most));
+		ReplayWallPrepCall (call, true);
+
+		if ((type == FWallPrepCall::Wall && memcmp (swall + x1, BenchSwall + x1, (x2 - x1) * sizeof(fixed_t)) != 0) ||
+			(type != FWallPrepCall::Most && memcmp (lwall + x1, BenchLwall + x1, (x2 - x1) * sizeof(fixed_t)) != 0) ||
+			(type == FWallPrepCall::Most && memcmp (most, BenchMost, x2 * sizeof(short)) != 0))
+		{
+			bad++;
+		}
+	}
+	return bad;
+}
+#endif
+
+//==========================================================================
+//
+// CCMD benchwallprep
+//
+// benchwallprep [repetitions]
+//
+//==========================================================================
+
+CCMD (benchwallprep)
+{
+	static const char *const names[] = { "PrepWall", "PrepLWall", "WallMost" };
+
+	if (gamestate != GS_LEVEL || players[consoleplayer].camera == NULL)
+	{
+		Printf ("benchwallprep needs a level to be loaded\n");
+		return;
+	}
+	if (!CPU.bSSE2)
+	{
+		Printf ("benchwallprep: this CPU has no SSE2\n");
+		return;
+	}
+
+	int reps = argv.argc() > 1 ? MAX (1, atoi (argv[1])) : 100;
+	int width = screen->GetWidth();
+	int height = screen->GetHeight();
+	TArray<FWallPrepCall> calls;
+
+	// Record the walls of the current view.
+	DSimpleCanvas *canvas = new DSimpleCanvas (width, height);
+	canvas->ObjectFlags |= OF_Fixed;
+	canvas->Lock ();
+	WallPrepRecord = &calls;
+	R_RenderViewToCanvas (players[consoleplayer].camera, canvas, 0, 0, width, height);
+	WallPrepRecord = NULL;
+	canvas->Unlock ();
+	canvas->Destroy ();
+	canvas->ObjectFlags |= OF_YesReallyDelete;
+	delete canvas;
+
+	FWallTmapVals savedwallt = WallT;
+	int savedcenterx = centerx;
+	float savedscale = WallTMapScale2;
+
+	Printf ("benchwallprep: %u calls, %d repetitions at %dx%d\n", calls.Size(), reps, width, height);
+	for (int type = FWallPrepCall::Wall; type <= FWallPrepCall::Most; ++type)
+	{
+		int count = 0;
+		for (unsigned i = 0; i < calls.Size(); ++i)
+		{
+			count += calls[i].Type == type;
+		}
+		double c = ReplayWallPrep (calls, type, false, reps);
+		double sse2 = ReplayWallPrep (calls, type, true, reps);
+#ifdef SSE2_WALLPREP
+		int bad = CompareWallPrep (calls, type);
+		Printf ("  %-9s %5d calls  C=%.3f ms  SSE2=%.3f ms  %s\n", names[type], count, c, sse2,
+			bad == 0 ? "identical" : "DIFFERENT");
+		if (bad != 0)
+		{
+			Printf ("    %d calls had different results\n", bad);
+		}
+#else
+		Printf ("  %-9s %5d calls  C=%.3f ms  SSE2=%.3f ms\n", names[type], count, c, sse2);
+#endif
+	}
+#ifndef SSE2_WALLPREP
+	Printf ("  This build does its math with the x87, so the game always uses the C\n"
+		"  versions and their results are not compared.\n");
+#endif
+
+	WallT = savedwallt;
+	centerx = savedcenterx;
+	WallTMapScale2 = savedscale;
+}
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef __R_BENCH_H
+#define __R_BENCH_H
+
+// Renders the current level from every start spot and writes the timings
+// to filename. A width or height of 0 uses the screen size.
+bool R_BenchRender (const char *filename, int width = 0, int height = 0);
+
+#endif
@@ -27,6 +27,9 @@
 
 
 #include <stdlib.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "templates.h"
 
@@ -103,8 +106,10 @@ TArray<PortalDrawseg> WallPortals(1000);	// note: this array needs to go away as
 
 
 subsector_t *InSubsector;
+TArray<subsector_t *> *SubsectorLog;
 
 CVAR (Bool, r_drawflat, false, 0)		// [RH] Don't texture segs?
+CVAR (Bool, r_cullclosed, false, 0)		// Add closed columns to the clip list (can hide sprites)
 
 
 void R_StoreWallRange (int start, int stop);
@@ -146,6 +151,171 @@ struct cliprange_t
 static cliprange_t     *newend;
 static cliprange_t		solidsegs[MAXWIDTH/2+2];
 
+//==========================================================================
+//
+// Column bitset clipper
+//
+// Inserting into solidsegs has to shift every post behind the new one,
+// which adds up in busy views at high resolutions. This keeps one bit per
+// screen column instead, set once the column is closed, plus two summary
+// levels above it: one bit per word that has any column closed and one
+// bit per word that has all of them closed. Finding the next open or
+// closed column only has to look at a few words, whatever the width.
+//
+// The posts of the old list never touch each other, so a run of closed
+// columns is always exactly one post. Both clippers therefore make the
+// same R_StoreWallRange calls in the same order, and r_clipbitset can be
+// used to compare them.
+//
+//==========================================================================
+
+CVAR (Bool, r_clipbitset, true, 0)
+
+enum
+{
+	CLIP_WORDS = (MAXWIDTH + 31) / 32,
+	CLIP_SUMMARY = (CLIP_WORDS + 31) / 32
+};
+
+static bool		ClipBits;		// r_clipbitset, latched by R_ClearClipSegs
+static DWORD	ClipCols[CLIP_WORDS];
+static DWORD	ClipAny[CLIP_SUMMARY];
+static DWORD	ClipFull[CLIP_SUMMARY];
+
+static inline int LowestBit (DWORD v)
+{
+#if defined(__GNUC__)
+	return __builtin_ctz (v);
+#elif defined(_MSC_VER)
+	unsigned long i;
+	_BitScanForward (&i, v);
+	return i;
+#else
+	int i = 0;
+	while (!(v & 1))
+	{
+		v >>= 1;
+		i++;
+	}
+	return i;
+#endif
+}
+
+// Returns the first word at or after w whose bit in the summary is set
+// (or clear, if invert is true), or CLIP_WORDS if there is none.
+static int ClipNextWord (const DWORD *summary, bool invert, int w)
+{
+	int s = w >> 5;
+	if (s >= CLIP_SUMMARY)
+	{
+		return CLIP_WORDS;
+	}
+	DWORD bits = (invert ? ~summary[s] : summary[s]) & (~0u << (w & 31));
+	while (bits == 0)
+	{
+		if (++s == CLIP_SUMMARY)
+		{
+			return CLIP_WORDS;
+		}
+		bits = invert ? ~summary[s] : summary[s];
+	}
+	return MIN<int> (CLIP_WORDS, (s << 5) + LowestBit (bits));
+}
+
+// Returns the first open column in [x, end), or end.
+static int ClipFindOpen (int x, int end)
+{
+	if (x >= end)
+	{
+		return end;
+	}
+	int w = x >> 5;
+	DWORD bits = ~ClipCols[w] & (~0u << (x & 31));
+	if (bits == 0)
+	{
+		w = ClipNextWord (ClipFull, true, w + 1);
+		if (w == CLIP_WORDS)
+		{
+			return end;
+		}
+		bits = ~ClipCols[w];
+	}
+	return MIN<int> (end, (w << 5) + LowestBit (bits));
+}
+
+// Returns the first closed column in [x, end), or end.
+static int ClipFindClosed (int x, int end)
+{
+	if (x >= end)
+	{
+		return end;
+	}
+	int w = x >> 5;
+	DWORD bits = ClipCols[w] & (~0u << (x & 31));
+	if (bits == 0)
+	{
+		w = ClipNextWord (ClipAny, false, w + 1);
+		if (w == CLIP_WORDS)
+		{
+			return end;
+		}
+		bits = ClipCols[w];
+	}
+	return MIN<int> (end, (w << 5) + LowestBit (bits));
+}
+
+static void ClipCloseRange (int first, int last)
+{
+	first = MAX (first, 0);
+	last = MIN<int> (last, CLIP_WORDS * 32);
+	if (first >= last)
+	{
+		return;
+	}
+
+	int fw = first >> 5, lw = (last - 1) >> 5;
+	for (int w = fw; w <= lw; ++w)
+	{
+		DWORD mask = ~0u;
+		if (w == fw) mask &= ~0u << (first & 31);
+		if (w == lw) mask &= ~0u >> (31 - ((last - 1) & 31));
+
+		ClipCols[w] |= mask;
+		ClipAny[w >> 5] |= 1u << (w & 31);
+		if (ClipCols[w] == ~0u)
+		{
+			ClipFull[w >> 5] |= 1u << (w & 31);
+		}
+	}
+}
+
+// Returns true if no column in [first, last) is open.
+static inline bool ClipIsClosed (int first, int last)
+{
+	last = MIN<int> (last, MAXWIDTH);
+	return ClipFindOpen (MAX (first, 0), last) >= last;
+}
+
+static bool R_ClipWallSegmentBits (int first, int last, bool solid)
+{
+	int x = MAX (first, 0);
+	int end = MIN<int> (last, MAXWIDTH);
+	bool res = false;
+
+	while ((x = ClipFindOpen (x, end)) < end)
+	{
+		int stop = ClipFindClosed (x, end);
+		R_StoreWallRange (x, stop);
+		res = true;
+		x = stop;
+	}
+	if (res && solid && !(fake3D & FAKE3D_FAKEMASK))
+	{
+		ClipCloseRange (first, end);
+	}
+	return res;
+}
+
 
 
 //==========================================================================
@@ -165,6 +335,11 @@ bool R_ClipWallSegment (int first, int last, bool solid)
 	int i, j;
 	bool res = false;
 
+	if (ClipBits)
+	{
+		return R_ClipWallSegmentBits (first, last, solid);
+	}
+
 	// Find the first range that touches the range
 	// (adjacent pixels are touching).
 	start = solidsegs;
@@ -262,10 +437,102 @@ crunch:
 	return true;
 }
 
+//==========================================================================
+//
+// R_AddClosedColumns
+//
+// Two-sided lines never go into the clip list, even when their upper and
+// lower parts together close off the view completely, so everything behind
+// a closed door or a row of lowered ceilings still had to be walked and
+// clipped column by column. This finds the columns in [first, last) where
+// ceilingclip has met floorclip and adds them to the clip list, so that
+// R_CheckBBox can reject the nodes behind them. No wall or plane can be
+// drawn in such a column anymore. Sprites are added per subsector, though,
+// so a sprite behind the closed columns that sticks out into open ones is
+// lost along with its subsector, just as behind one-sided walls.
+//
+//==========================================================================
+
+static void R_AddClosedRange (int first, int last)
+{
+	cliprange_t *start, *next;
+
+	if (ClipBits)
+	{
+		ClipCloseRange (first, last);
+		return;
+	}
+
+	start = solidsegs;
+	while (start->last < first)
+		start++;
+
+	if (last < start->first)
+	{
+		// Insert a new post before start.
+		for (next = newend++; next != start; next--)
+		{
+			*next = *(next-1);
+		}
+		next->first = first;
+		next->last = last;
+		return;
+	}
+
+	if (first < start->first)
+	{
+		start->first = first;
+	}
+	if (last <= start->last)
+	{
+		return;
+	}
+
+	// Merge every post the new range touches into start.
+	next = start;
+	while (last >= (next+1)->first)
+	{
+		next++;
+		if (last <= next->last)
+		{
+			break;
+		}
+	}
+	start->last = MAX<int> (last, next->last);
+	if (next != start)
+	{
+		memmove (start + 1, next + 1, (newend - next - 1) * sizeof(*start));
+		newend -= next - start;
+	}
+}
+
+void R_AddClosedColumns (int first, int last)
+{
+	for (int x = first; x < last; )
+	{
+		if (ceilingclip[x] < floorclip[x])
+		{
+			x++;
+			continue;
+		}
+		int start = x;
+		while (x < last && ceilingclip[x] >= floorclip[x])
+		{
+			x++;
+		}
+		R_AddClosedRange (start, x);
+	}
+}
+
 bool R_CheckClipWallSegment (int first, int last)
 {
 	cliprange_t *start;
 
+	if (ClipBits)
+	{
+		return !ClipIsClosed (first, last);
+	}
+
 	// Find the first range that touches the range
 	// (adjacent pixels are touching).
 	start = solidsegs;
@@ -293,6 +560,16 @@ bool R_CheckClipWallSegment (int first, int last)
 //
 void R_ClearClipSegs (short left, short right)
 {
+	ClipBits = r_clipbitset;
+	if (ClipBits)
+	{
+		memset (ClipCols, 0, sizeof(ClipCols));
+		memset (ClipAny, 0, sizeof(ClipAny));
+		memset (ClipFull, 0, sizeof(ClipFull));
+		ClipCloseRange (0, left);
+		ClipCloseRange (right, CLIP_WORDS * 32);
+		return;
+	}
 	solidsegs[0].first = -0x7fff;	// new short limit --  killough
 	solidsegs[0].last = left;
 	solidsegs[1].first = right;
@@ -744,6 +1021,13 @@ void R_AddLine (seg_t *line)
 	if (R_ClipWallSegment (WallC.sx1, WallC.sx2, solid))
 	{
 		InSubsector->flags |= SSECF_DRAWN;
+
+		// 3D floors keep their own copies of the clip arrays and may still
+		// draw in columns that the real ones have closed.
+		if (!solid && r_cullclosed && !fakeActive && !fake3D)
+		{
+			R_AddClosedColumns (WallC.sx1, WallC.sx2);
+		}
 	}
 }
 
@@ -960,6 +1244,11 @@ static bool R_CheckBBox (fixed_t *bspcoord)	// killough 1/28/98: static
 	if (sx2 <= sx1)
 		return false;
 
+	if (ClipBits)
+	{
+		return !ClipIsClosed (sx1, sx2);
+	}
+
 	start = solidsegs;
 	while (start->last < sx2)
 		start++;
@@ -1041,6 +1330,10 @@ void R_Subsector (subsector_t *sub)
 	{
 		outersubsector = true;
 		InSubsector = sub;
+		if (SubsectorLog != NULL)
+		{
+			SubsectorLog->Push (sub);
+		}
 	}
 
 #ifdef RANGECHECK
@@ -107,12 +107,16 @@ extern size_t			FirstInterestingDrawseg;
 extern int			WindowLeft, WindowRight;
 extern WORD			MirrorFlags;
 
+extern TArray<subsector_t *> *SubsectorLog;	// if set, every subsector drawn is added to it
+
 typedef void (*drawfunc_t) (int start, int stop);
 
 EXTERN_CVAR (Bool, r_drawflat)		// [RH] Don't texture segs?
+EXTERN_CVAR (Bool, r_cullclosed)
 
 // BSP?
 void R_ClearClipSegs (short left, short right);
+void R_AddClosedColumns (int first, int last);
 void R_ClearDrawSegs ();
 void R_RenderBSPNode (void *node);
 
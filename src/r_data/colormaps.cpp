@@ -53,6 +53,8 @@
 #include "templates.h"
 #include "r_utility.h"
 #include "r_renderer.h"
+#include "r_thread.h"
+#include "stats.h"
 
 static bool R_CheckForFixedLights(const BYTE *colormaps);
 
@@ -105,6 +107,14 @@ static FSpecialColormapParameters SpecialColormapParms[] =
 
 static void FreeSpecialLights();
 
+// GetSpecialLights is called for every sprite in a colored or fogged
+// sector, so the colormaps are hashed instead of searched in a list.
+// NormalLight is not in the hash because its colors can change.
+static TMap<DWORD, FDynamicColormap *> SpecialLightsHash;
+static int SpecialLightsCount;
+static unsigned int SpecialLightsHits, SpecialLightsMisses;	// Only for the stat, so wrapping around is fine
+static cycle_t SpecialLightsBuildCycles;
+
 
 
 //==========================================================================
@@ -183,20 +193,41 @@ int AddSpecialColormap(float r1, float g1, float b1, float r2, float g2, float b
 //
 //==========================================================================
 
+static inline DWORD SpecialLightsKey (PalEntry color, PalEntry fade, int desaturate)
+{
+	return (DWORD)color * 31 + (DWORD)fade * 0x9E3779B1 + desaturate;
+}
+
 FDynamicColormap *GetSpecialLights (PalEntry color, PalEntry fade, int desaturate)
 {
 	FDynamicColormap *colormap;
 
 	// If this colormap has already been created, just return it
-	for (colormap = &NormalLight; colormap != NULL; colormap = colormap->Next)
+	if (color == NormalLight.Color &&
+		fade == NormalLight.Fade &&
+		desaturate == NormalLight.Desaturate)
 	{
-		if (color == colormap->Color &&
-			fade == colormap->Fade &&
-			desaturate == colormap->Desaturate)
+		SpecialLightsHits++;
+		return &NormalLight;
+	}
+
+	DWORD key = SpecialLightsKey (color, fade, desaturate);
+	FDynamicColormap **bucket = SpecialLightsHash.CheckKey (key);
+
+	if (bucket != NULL)
+	{
+		for (colormap = *bucket; colormap != NULL; colormap = colormap->HashNext)
 		{
-			return colormap;
+			if (color == colormap->Color &&
+				fade == colormap->Fade &&
+				desaturate == colormap->Desaturate)
+			{
+				SpecialLightsHits++;
+				return colormap;
+			}
 		}
 	}
+	SpecialLightsMisses++;
 
 	// Not found. Create it.
 	colormap = new FDynamicColormap;
@@ -205,6 +236,9 @@ FDynamicColormap *GetSpecialLights (PalEntry color, PalEntry fade, int desaturat
 	colormap->Fade = fade;
 	colormap->Desaturate = desaturate;
 	NormalLight.Next = colormap;
+	colormap->HashNext = bucket != NULL ? *bucket : NULL;
+	SpecialLightsHash[key] = colormap;
+	SpecialLightsCount++;
 
 	if (Renderer->UsesColormap())
 	{
@@ -216,6 +250,14 @@ FDynamicColormap *GetSpecialLights (PalEntry color, PalEntry fade, int desaturat
 	return colormap;
 }
 
+ADD_STAT (colormaps)
+{
+	FString out;
+	out.Format ("%d colormaps  hits=%u  misses=%u  build=%04.1f ms",
+		SpecialLightsCount, SpecialLightsHits, SpecialLightsMisses, SpecialLightsBuildCycles.TimeMS());
+	return out;
+}
+
 //==========================================================================
 //
 // Free all lights created with GetSpecialLights
@@ -233,29 +275,83 @@ static void FreeSpecialLights()
 		delete colormap;
 	}
 	NormalLight.Next = NULL;
+	SpecialLightsHash.Clear();
+	SpecialLightsCount = 0;
+	SpecialLightsHits = SpecialLightsMisses = 0;
 }
 
 //==========================================================================
 //
 // Builds NUMCOLORMAPS colormaps lit with the specified color
 //
+// The light levels are independent of each other, so they are split up
+// between the render threads. ColorMatcher.Pick has to search the whole
+// palette, and the darker levels keep asking for the same few colors, so
+// every slice remembers its most recent answers.
+//
 //==========================================================================
 
-void FDynamicColormap::BuildLights ()
+struct FBuildLightsArgs
 {
+	FDynamicColormap *Map;
+	const PalEntry *BaseColors;
+	int lr, lg, lb;
+};
+
+static void BuildLightsSlice (int slice, int numslices, void *data)
+{
+	const FBuildLightsArgs *args = (const FBuildLightsArgs *)data;
+	FDynamicColormap *map = args->Map;
+	PalEntry colors[256];
+	DWORD pickkeys[1024];
+	BYTE pickvals[1024];
 	int l, c;
-	int lr, lg, lb, ld, ild;
-	PalEntry colors[256], basecolors[256];
-	BYTE *shade;
+
+	memset (pickkeys, 0xff, sizeof(pickkeys));
+
+	for (l = NUMCOLORMAPS * slice / numslices; l < NUMCOLORMAPS * (slice + 1) / numslices; l++)
+	{
+		DoBlending (args->BaseColors, colors, 256,
+			map->Fade.r, map->Fade.g, map->Fade.b, l * (256 / NUMCOLORMAPS));
+
+		BYTE *shade = map->Maps + 256*l;
+		bool white = (DWORD)map->Color == MAKERGB(255,255,255);
+		for (c = 0; c < 256; c++)
+		{
+			int r = colors[c].r, g = colors[c].g, b = colors[c].b;
+			if (!white)
+			{ // Colored light, so do the (slightly) slower thing
+				r = (r*args->lr)>>8;
+				g = (g*args->lg)>>8;
+				b = (b*args->lb)>>8;
+			}
+			DWORD rgb = (r << 16) | (g << 8) | b;
+			DWORD hash = (rgb ^ (rgb >> 10) ^ (rgb >> 20)) & 1023;
+			if (pickkeys[hash] != rgb)
+			{
+				pickkeys[hash] = rgb;
+				pickvals[hash] = ColorMatcher.Pick (r, g, b);
+			}
+			shade[c] = pickvals[hash];
+		}
+	}
+}
+
+void FDynamicColormap::BuildLights ()
+{
+	int c;
+	int ld, ild;
+	PalEntry basecolors[256];
+	FBuildLightsArgs args;
 
 	if (Maps == NULL)
 		return;
 
 	// Scale light to the range 0-256, so we can avoid
 	// dividing by 255 in the bottom loop.
-	lr = Color.r*256/255;
-	lg = Color.g*256/255;
-	lb = Color.b*256/255;
+	args.lr = Color.r*256/255;
+	args.lg = Color.g*256/255;
+	args.lb = Color.b*256/255;
 	ld = Desaturate*256/255;
 	if (ld < 0)	// No negative desaturations, please.
 	{
@@ -284,30 +380,11 @@ void FDynamicColormap::BuildLights ()
 	}
 
 	// build normal (but colored) light mappings
-	for (l = 0; l < NUMCOLORMAPS; l++)
-	{
-		DoBlending (basecolors, colors, 256,
-			Fade.r, Fade.g, Fade.b, l * (256 / NUMCOLORMAPS));
-
-		shade = Maps + 256*l;
-		if ((DWORD)Color == MAKERGB(255,255,255))
-		{ // White light, so we can just pick the colors directly
-			for (c = 0; c < 256; c++)
-			{
-				*shade++ = ColorMatcher.Pick (colors[c].r, colors[c].g, colors[c].b);
-			}
-		}
-		else
-		{ // Colored light, so do the (slightly) slower thing
-			for (c = 0; c < 256; c++)
-			{
-				*shade++ = ColorMatcher.Pick (
-					(colors[c].r*lr)>>8,
-					(colors[c].g*lg)>>8,
-					(colors[c].b*lb)>>8);
-			}
-		}
-	}
+	args.Map = this;
+	args.BaseColors = basecolors;
+	SpecialLightsBuildCycles.Clock();
+	R_RunSliced (BuildLightsSlice, &args);
+	SpecialLightsBuildCycles.Unclock();
 }
 
 //==========================================================================
@@ -25,6 +25,7 @@ struct FDynamicColormap
 	PalEntry Fade;
 	int Desaturate;
 	FDynamicColormap *Next;
+	FDynamicColormap *HashNext;		// Next map in the same GetSpecialLights hash bucket
 };
 
 // For hardware-accelerated weapon sprites in colored sectors
@@ -80,7 +80,12 @@ void (*R_DrawSpanTranslucent)(void);
 void (*R_DrawSpanMaskedTranslucent)(void);
 void (*R_DrawSpanAddClamp)(void);
 void (*R_DrawSpanMaskedAddClamp)(void);
+void (*R_DrawTiltedSpan)(BYTE *, BYTE *const *, int, DWORD, DWORD, DWORD, DWORD);
 void (STACK_ARGS *rt_map4cols)(int,int,int);
+void (STACK_ARGS *rt_add4cols)(int,int,int);
+void (STACK_ARGS *rt_addclamp4cols)(int,int,int);
+void (STACK_ARGS *rt_subclamp4cols)(int,int,int);
+void (STACK_ARGS *rt_revsubclamp4cols)(int,int,int);
 
 //
 // R_DrawColumn
@@ -100,6 +105,9 @@ int				dc_color;				// [RH] Color for column filler
 DWORD			dc_srccolor;
 DWORD			*dc_srcblend;			// [RH] Source and destination
 DWORD			*dc_destblend;			// blending lookups
+fixed_t			dc_srcalpha;			// Same levels for the BGRA drawers
+fixed_t			dc_destalpha;
+DWORD			dc_srcinvert;
 
 // first pixel in a column (possibly virtual) 
 const BYTE*		dc_source;				
@@ -1054,41 +1062,28 @@ void R_SetupSpanBits(FTexture *tex)
 #endif
 }
 
+//==========================================================================
 //
-// Draws the actual span.
-#ifndef X86_ASM
-void R_DrawSpanP_C (void)
+// R_DrawSpanArgs
+//
+// Draws one span without touching any of the ds_* globals, so it is safe
+// to call from the renderer's worker threads.
+//
+//==========================================================================
+
+void R_DrawSpanArgs (const FDrawSpanArgs &args)
 {
-	dsfixed_t			xfrac;
-	dsfixed_t			yfrac;
-	dsfixed_t			xstep;
-	dsfixed_t			ystep;
-	BYTE*				dest;
-	const BYTE*			source = ds_source;
-	const BYTE*			colormap = ds_colormap;
-	int 				count;
+	dsfixed_t			xfrac = args.xfrac;
+	dsfixed_t			yfrac = args.yfrac;
+	dsfixed_t			xstep = args.xstep;
+	dsfixed_t			ystep = args.ystep;
+	BYTE*				dest = args.dest;
+	const BYTE*			source = args.source;
+	const BYTE*			colormap = args.colormap;
+	int 				count = args.count;
 	int 				spot;
 
-#ifdef RANGECHECK 
-	if (ds_x2 < ds_x1 || ds_x1 < 0
-		|| ds_x2 >= screen->width || ds_y > screen->height)
-	{
-		I_Error ("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y);
-	}
-//		dscount++;
-#endif
-
-	xfrac = ds_xfrac;
-	yfrac = ds_yfrac;
-
-	dest = ylookup[ds_y] + ds_x1 + dc_destorg;
-
-	count = ds_x2 - ds_x1 + 1;
-
-	xstep = ds_xstep;
-	ystep = ds_ystep;
-
-	if (ds_xbits == 6 && ds_ybits == 6)
+	if (args.xbits == 6 && args.ybits == 6)
 	{
 		// 64x64 is the most common case by far, so special case it.
 		do
@@ -1107,9 +1102,9 @@ void R_DrawSpanP_C (void)
 	}
 	else
 	{
-		BYTE yshift = 32 - ds_ybits;
-		BYTE xshift = yshift - ds_xbits;
-		int xmask = ((1 << ds_xbits) - 1) << ds_ybits;
+		BYTE yshift = 32 - args.ybits;
+		BYTE xshift = yshift - args.xbits;
+		int xmask = ((1 << args.xbits) - 1) << args.ybits;
 
 		do
 		{
@@ -1127,6 +1122,36 @@ void R_DrawSpanP_C (void)
 	}
 }
 
+//
+// Draws the actual span.
+#ifndef X86_ASM
+void R_DrawSpanP_C (void)
+{
+	FDrawSpanArgs args;
+
+#ifdef RANGECHECK 
+	if (ds_x2 < ds_x1 || ds_x1 < 0
+		|| ds_x2 >= screen->width || ds_y > screen->height)
+	{
+		I_Error ("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y);
+	}
+//		dscount++;
+#endif
+
+	args.dest = ylookup[ds_y] + ds_x1 + dc_destorg;
+	args.source = ds_source;
+	args.colormap = ds_colormap;
+	args.xfrac = ds_xfrac;
+	args.yfrac = ds_yfrac;
+	args.xstep = ds_xstep;
+	args.ystep = ds_ystep;
+	args.count = ds_x2 - ds_x1 + 1;
+	args.y = ds_y;
+	args.xbits = ds_xbits;
+	args.ybits = ds_ybits;
+	R_DrawSpanArgs (args);
+}
+
 // [RH] Draw a span with holes
 void R_DrawSpanMaskedP_C (void)
 {
@@ -1471,6 +1496,23 @@ void R_DrawSpanMaskedAddClampP_C (void)
 	}
 }
 
+// The texture coordinates are stepped linearly; R_MapTiltedPlane takes
+// care of the perspective by calling this for short pieces of each row.
+void R_DrawTiltedSpanP_C (BYTE *dest, BYTE *const *lighting, int count, DWORD u, DWORD v, DWORD stepu, DWORD stepv)
+{
+	const BYTE *source = ds_source;
+	BYTE vshift = 32 - ds_ybits;
+	BYTE ushift = vshift - ds_xbits;
+	int umask = ((1 << ds_xbits) - 1) << ds_ybits;
+
+	for (int i = 0; i < count; ++i)
+	{
+		dest[i] = lighting[i][source[(v >> vshift) | ((u >> ushift) & umask)]];
+		u += stepu;
+		v += stepv;
+	}
+}
+
 // [RH] Just fill a span with a color
 void R_FillSpan (void)
 {
@@ -2164,6 +2206,33 @@ const BYTE *R_GetColumn (FTexture *tex, int col)
 }
 
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__i386__) || defined(__amd64__)
+void STACK_ARGS rt_add4cols_sse2 (int sx, int yl, int yh);
+void STACK_ARGS rt_addclamp4cols_sse2 (int sx, int yl, int yh);
+void STACK_ARGS rt_subclamp4cols_sse2 (int sx, int yl, int yh);
+void STACK_ARGS rt_revsubclamp4cols_sse2 (int sx, int yl, int yh);
+void R_DrawSpanTranslucentP_SSE2 (void);
+void R_DrawSpanAddClampP_SSE2 (void);
+void R_DrawTiltedSpanP_SSE2 (BYTE *dest, BYTE *const *lighting, int count, DWORD u, DWORD v, DWORD stepu, DWORD stepv);
+#endif
+
+void R_DrawColumn_RGBA (void);
+void R_DrawTranslatedColumn_RGBA (void);
+void R_DrawShadedColumn_RGBA (void);
+void R_DrawSpan_RGBA (void);
+void R_DrawSpanMasked_RGBA (void);
+void R_DrawSpanTranslucent_RGBA (void);
+void R_DrawSpanMaskedTranslucent_RGBA (void);
+void R_DrawSpanAddClamp_RGBA (void);
+void R_DrawSpanMaskedAddClamp_RGBA (void);
+void STACK_ARGS rt_map4cols_RGBA (int sx, int yl, int yh);
+void STACK_ARGS rt_add4cols_RGBA (int sx, int yl, int yh);
+void STACK_ARGS rt_addclamp4cols_RGBA (int sx, int yl, int yh);
+void STACK_ARGS rt_subclamp4cols_RGBA (int sx, int yl, int yh);
+void STACK_ARGS rt_revsubclamp4cols_RGBA (int sx, int yl, int yh);
+
+bool r_drawbgra;
+
 // [RH] Initialize the column drawer pointers
 void R_InitColumnDrawers ()
 {
@@ -2197,6 +2266,50 @@ void R_InitColumnDrawers ()
 	R_DrawSpanMaskedTranslucent = R_DrawSpanMaskedTranslucentP_C;
 	R_DrawSpanAddClamp			= R_DrawSpanAddClampP_C;
 	R_DrawSpanMaskedAddClamp	= R_DrawSpanMaskedAddClampP_C;
+	R_DrawTiltedSpan			= R_DrawTiltedSpanP_C;
+#ifdef X86_ASM
+	rt_add4cols					= rt_add4cols_asm;
+	rt_addclamp4cols			= rt_addclamp4cols_asm;
+#else
+	rt_add4cols					= rt_add4cols_c;
+	rt_addclamp4cols			= rt_addclamp4cols_c;
+#endif
+	rt_subclamp4cols			= rt_subclamp4cols_c;
+	rt_revsubclamp4cols			= rt_revsubclamp4cols_c;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__i386__) || defined(__amd64__)
+	if (CPU.bSSE2)
+	{
+#ifndef X86_ASM
+		// The 32-bit asm versions of these are still preferred when available.
+		rt_add4cols				= rt_add4cols_sse2;
+		rt_addclamp4cols		= rt_addclamp4cols_sse2;
+#endif
+		rt_subclamp4cols		= rt_subclamp4cols_sse2;
+		rt_revsubclamp4cols		= rt_revsubclamp4cols_sse2;
+		R_DrawSpanTranslucent	= R_DrawSpanTranslucentP_SSE2;
+		R_DrawSpanAddClamp		= R_DrawSpanAddClampP_SSE2;
+		R_DrawTiltedSpan		= R_DrawTiltedSpanP_SSE2;
+	}
+#endif
+
+	if (r_drawbgra)
+	{
+		R_DrawColumn				= R_DrawColumn_RGBA;
+		R_DrawTranslatedColumn		= R_DrawTranslatedColumn_RGBA;
+		R_DrawShadedColumn			= R_DrawShadedColumn_RGBA;
+		R_DrawSpan					= R_DrawSpan_RGBA;
+		R_DrawSpanMasked			= R_DrawSpanMasked_RGBA;
+		R_DrawSpanTranslucent		= R_DrawSpanTranslucent_RGBA;
+		R_DrawSpanMaskedTranslucent	= R_DrawSpanMaskedTranslucent_RGBA;
+		R_DrawSpanAddClamp			= R_DrawSpanAddClamp_RGBA;
+		R_DrawSpanMaskedAddClamp	= R_DrawSpanMaskedAddClamp_RGBA;
+		rt_map4cols					= rt_map4cols_RGBA;
+		rt_add4cols					= rt_add4cols_RGBA;
+		rt_addclamp4cols			= rt_addclamp4cols_RGBA;
+		rt_subclamp4cols			= rt_subclamp4cols_RGBA;
+		rt_revsubclamp4cols			= rt_revsubclamp4cols_RGBA;
+	}
 }
 
 // [RH] Choose column drawers in a single place
@@ -2247,6 +2360,9 @@ static bool R_SetBlendFunc (int op, fixed_t fglevel, fixed_t bglevel, int flags)
 		dc_srcblend = Col2RGB8_LessPrecision[fglevel>>10];
 		dc_destblend = Col2RGB8_LessPrecision[bglevel>>10];
 	}
+	dc_srcalpha = fglevel;
+	dc_destalpha = bglevel;
+	dc_srcinvert = (flags & STYLEF_InvertSource) ? 0xffffff : 0;
 	switch (op)
 	{
 	case STYLEOP_Add:
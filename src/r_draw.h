@@ -40,6 +40,9 @@ extern "C" int			dc_color;		// [RH] For flat colors (no texturing)
 extern "C" DWORD		dc_srccolor;
 extern "C" DWORD		*dc_srcblend;
 extern "C" DWORD		*dc_destblend;
+extern "C" fixed_t		dc_srcalpha;	// Blending levels for the BGRA drawers
+extern "C" fixed_t		dc_destalpha;
+extern "C" DWORD		dc_srcinvert;
 
 // first pixel in a column
 extern "C" const BYTE*	dc_source;
@@ -93,6 +96,21 @@ extern void (*R_DrawTranslatedColumn)(void);
 
 // Span drawing for rows, floor/ceiling. No Spectre effect needed.
 extern void (*R_DrawSpan)(void);
+
+// Everything R_DrawSpan needs, so that spans can be recorded and
+// drawn later, possibly from another thread.
+struct FDrawSpanArgs
+{
+	BYTE			*dest;
+	const BYTE		*source;
+	const BYTE		*colormap;
+	dsfixed_t		xfrac, yfrac;
+	dsfixed_t		xstep, ystep;
+	int				count;
+	int				y;
+	BYTE			xbits, ybits;
+};
+void R_DrawSpanArgs (const FDrawSpanArgs &args);
 void R_SetupSpanBits(FTexture *tex);
 void R_SetSpanColormap(BYTE *colormap);
 void R_SetSpanSource(const BYTE *pixels);
@@ -112,6 +130,9 @@ extern void (*R_DrawSpanAddClamp)(void);
 // Span drawing for masked, translucent, additive textures.
 extern void (*R_DrawSpanMaskedAddClamp)(void);
 
+// Affine span drawing for tilted planes, with a colormap for every pixel.
+extern void (*R_DrawTiltedSpan)(BYTE *dest, BYTE *const *lighting, int count, DWORD u, DWORD v, DWORD stepu, DWORD stepv);
+
 // [RH] Span blit into an interleaved intermediate buffer
 extern void (*R_DrawColumnHoriz)(void);
 void R_DrawMaskedColumnHoriz (const BYTE *column, const FTexture::Span *spans);
@@ -119,6 +140,9 @@ void R_DrawMaskedColumnHoriz (const BYTE *column, const FTexture::Span *spans);
 // [RH] Initialize the above pointers
 void R_InitColumnDrawers ();
 
+// The above pointers draw into a BGRA canvas (see r_draw_rgba.cpp)
+extern bool r_drawbgra;
+
 // [RH] Moves data from the temporary buffer to the screen.
 extern "C"
 {
@@ -144,8 +168,8 @@ void rt_tlaterevsubclamp1col (int hx, int sx, int yl, int yh);
 void STACK_ARGS rt_map4cols_c (int sx, int yl, int yh);
 void STACK_ARGS rt_add4cols_c (int sx, int yl, int yh);
 void STACK_ARGS rt_addclamp4cols_c (int sx, int yl, int yh);
-void STACK_ARGS rt_subclamp4cols (int sx, int yl, int yh);
-void STACK_ARGS rt_revsubclamp4cols (int sx, int yl, int yh);
+void STACK_ARGS rt_subclamp4cols_c (int sx, int yl, int yh);
+void STACK_ARGS rt_revsubclamp4cols_c (int sx, int yl, int yh);
 
 void STACK_ARGS rt_tlate4cols (int sx, int yl, int yh);
 void STACK_ARGS rt_tlateadd4cols (int sx, int yl, int yh);
@@ -164,21 +188,21 @@ void STACK_ARGS rt_addclamp4cols_asm (int sx, int yl, int yh);
 }
 
 extern void (STACK_ARGS *rt_map4cols)(int sx, int yl, int yh);
+extern void (STACK_ARGS *rt_add4cols)(int sx, int yl, int yh);
+extern void (STACK_ARGS *rt_addclamp4cols)(int sx, int yl, int yh);
+extern void (STACK_ARGS *rt_subclamp4cols)(int sx, int yl, int yh);
+extern void (STACK_ARGS *rt_revsubclamp4cols)(int sx, int yl, int yh);
 
 #ifdef X86_ASM
 #define rt_copy1col			rt_copy1col_asm
 #define rt_copy4cols		rt_copy4cols_asm
 #define rt_map1col			rt_map1col_asm
 #define rt_shaded4cols		rt_shaded4cols_asm
-#define rt_add4cols			rt_add4cols_asm
-#define rt_addclamp4cols	rt_addclamp4cols_asm
 #else
 #define rt_copy1col			rt_copy1col_c
 #define rt_copy4cols		rt_copy4cols_c
 #define rt_map1col			rt_map1col_c
 #define rt_shaded4cols		rt_shaded4cols_c
-#define rt_add4cols			rt_add4cols_c
-#define rt_addclamp4cols	rt_addclamp4cols_c
 #endif
 
 void rt_draw4cols (int sx);
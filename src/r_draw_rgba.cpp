@@ -0,0 +1,343 @@
+/*
+** r_draw_rgba.cpp
+** True color versions of the column and span drawers
+**
+** R_InitColumnDrawers picks these when r_drawbgra is set, which
+** R_SetupBuffer does for canvases with BGRA pixels. Textures and
+** colormaps are still palettized; only the final lookup goes through
+** GPalette.BaseColors instead of writing the index. Translucency is
+** blended per channel with dc_srcalpha and dc_destalpha, so there is no
+** RGB32k rounding.
+**
+** dc_destorg, dc_dest and ylookup keep counting pixels, exactly as they
+** do for the palettized drawers, so every drawer turns its destination
+** into a DWORD pointer at the same pixel offset from dc_destorg.
+**
+*/
+
+#include "templates.h"
+#include "doomtype.h"
+#include "doomdef.h"
+#include "r_defs.h"
+#include "r_draw.h"
+#include "r_main.h"
+#include "v_video.h"
+#include "v_palette.h"
+
+//==========================================================================
+//
+// Helpers
+//
+//==========================================================================
+
+static inline DWORD *RGBADest (BYTE *dest)
+{
+	return (DWORD *)dc_destorg + (dest - dc_destorg);
+}
+
+static inline DWORD RGBAColor (const PalEntry *palette, BYTE color)
+{
+	return palette[color].d | 0xff000000;
+}
+
+// fga and bga are 0-256. The add clamps to white and the subtracts clamp
+// to black, so these work for every blend level R_SetBlendFunc allows.
+static inline DWORD BlendAdd (DWORD fg, DWORD bg, int fga, int bga)
+{
+	int r = (int((fg >> 16) & 0xff) * fga + int((bg >> 16) & 0xff) * bga) >> 8;
+	int g = (int((fg >> 8) & 0xff) * fga + int((bg >> 8) & 0xff) * bga) >> 8;
+	int b = (int(fg & 0xff) * fga + int(bg & 0xff) * bga) >> 8;
+	return 0xff000000 | (MIN(r, 255) << 16) | (MIN(g, 255) << 8) | MIN(b, 255);
+}
+
+// Returns fg - bg.
+static inline DWORD BlendSub (DWORD fg, DWORD bg, int fga, int bga)
+{
+	int r = MAX(0, int((fg >> 16) & 0xff) * fga - int((bg >> 16) & 0xff) * bga) >> 8;
+	int g = MAX(0, int((fg >> 8) & 0xff) * fga - int((bg >> 8) & 0xff) * bga) >> 8;
+	int b = MAX(0, int(fg & 0xff) * fga - int(bg & 0xff) * bga) >> 8;
+	return 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+//==========================================================================
+//
+// Columns
+//
+//==========================================================================
+
+void R_DrawColumn_RGBA (void)
+{
+	int count = dc_count;
+	if (count <= 0)
+		return;
+
+	DWORD *dest = RGBADest (dc_dest);
+	fixed_t frac = dc_texturefrac;
+	fixed_t fracstep = dc_iscale;
+	const PalEntry *palette = GPalette.BaseColors;
+	const BYTE *colormap = dc_colormap;
+	const BYTE *source = dc_source;
+	int pitch = dc_pitch;
+
+	do
+	{
+		*dest = RGBAColor (palette, colormap[source[frac>>FRACBITS]]);
+		dest += pitch;
+		frac += fracstep;
+	} while (--count);
+}
+
+void R_DrawTranslatedColumn_RGBA (void)
+{
+	int count = dc_count;
+	if (count <= 0)
+		return;
+
+	DWORD *dest = RGBADest (dc_dest);
+	fixed_t frac = dc_texturefrac;
+	fixed_t fracstep = dc_iscale;
+	const PalEntry *palette = GPalette.BaseColors;
+	const BYTE *colormap = dc_colormap;
+	const BYTE *translation = dc_translation;
+	const BYTE *source = dc_source;
+	int pitch = dc_pitch;
+
+	do
+	{
+		*dest = RGBAColor (palette, colormap[translation[source[frac>>FRACBITS]]]);
+		dest += pitch;
+		frac += fracstep;
+	} while (--count);
+}
+
+// The texels are 0-64 coverage levels for dc_color.
+void R_DrawShadedColumn_RGBA (void)
+{
+	int count = dc_count;
+	if (count <= 0)
+		return;
+
+	DWORD *dest = RGBADest (dc_dest);
+	fixed_t frac = dc_texturefrac;
+	fixed_t fracstep = dc_iscale;
+	const BYTE *colormap = dc_colormap;
+	const BYTE *source = dc_source;
+	DWORD fg = RGBAColor (GPalette.BaseColors, dc_color);
+	int pitch = dc_pitch;
+
+	do
+	{
+		int fga = colormap[source[frac>>FRACBITS]] << 2;
+		*dest = BlendAdd (fg, *dest, fga, 256 - fga);
+		dest += pitch;
+		frac += fracstep;
+	} while (--count);
+}
+
+//==========================================================================
+//
+// Spans
+//
+// With ds_xbits and ds_ybits both 6 the general spot calculation is the
+// same as the 64x64 special case of the palettized drawers, so these do
+// not need one.
+//
+//==========================================================================
+
+void R_DrawSpan_RGBA (void)
+{
+	DWORD *dest = (DWORD *)dc_destorg + ylookup[ds_y] + ds_x1;
+	int count = ds_x2 - ds_x1 + 1;
+	dsfixed_t xfrac = ds_xfrac;
+	dsfixed_t yfrac = ds_yfrac;
+	dsfixed_t xstep = ds_xstep;
+	dsfixed_t ystep = ds_ystep;
+	BYTE yshift = 32 - ds_ybits;
+	BYTE xshift = yshift - ds_xbits;
+	int xmask = ((1 << ds_xbits) - 1) << ds_ybits;
+	const PalEntry *palette = GPalette.BaseColors;
+	const BYTE *source = ds_source;
+	const BYTE *colormap = ds_colormap;
+
+	do
+	{
+		int spot = ((xfrac >> xshift) & xmask) + (yfrac >> yshift);
+		*dest++ = RGBAColor (palette, colormap[source[spot]]);
+		xfrac += xstep;
+		yfrac += ystep;
+	} while (--count);
+}
+
+void R_DrawSpanMasked_RGBA (void)
+{
+	DWORD *dest = (DWORD *)dc_destorg + ylookup[ds_y] + ds_x1;
+	int count = ds_x2 - ds_x1 + 1;
+	dsfixed_t xfrac = ds_xfrac;
+	dsfixed_t yfrac = ds_yfrac;
+	dsfixed_t xstep = ds_xstep;
+	dsfixed_t ystep = ds_ystep;
+	BYTE yshift = 32 - ds_ybits;
+	BYTE xshift = yshift - ds_xbits;
+	int xmask = ((1 << ds_xbits) - 1) << ds_ybits;
+	const PalEntry *palette = GPalette.BaseColors;
+	const BYTE *source = ds_source;
+	const BYTE *colormap = ds_colormap;
+
+	do
+	{
+		int spot = ((xfrac >> xshift) & xmask) + (yfrac >> yshift);
+		BYTE texdata = source[spot];
+		if (texdata != 0)
+		{
+			*dest = RGBAColor (palette, colormap[texdata]);
+		}
+		dest++;
+		xfrac += xstep;
+		yfrac += ystep;
+	} while (--count);
+}
+
+// R_DrawNormalPlane sets dc_destalpha to OPAQUE-alpha for translucent
+// planes and to FRACUNIT for additive ones, so one blend covers both.
+static void R_DrawSpanBlended_RGBA (bool masked)
+{
+	DWORD *dest = (DWORD *)dc_destorg + ylookup[ds_y] + ds_x1;
+	int count = ds_x2 - ds_x1 + 1;
+	dsfixed_t xfrac = ds_xfrac;
+	dsfixed_t yfrac = ds_yfrac;
+	dsfixed_t xstep = ds_xstep;
+	dsfixed_t ystep = ds_ystep;
+	BYTE yshift = 32 - ds_ybits;
+	BYTE xshift = yshift - ds_xbits;
+	int xmask = ((1 << ds_xbits) - 1) << ds_ybits;
+	const PalEntry *palette = GPalette.BaseColors;
+	const BYTE *source = ds_source;
+	const BYTE *colormap = ds_colormap;
+	int fga = dc_srcalpha >> 8;
+	int bga = dc_destalpha >> 8;
+
+	do
+	{
+		int spot = ((xfrac >> xshift) & xmask) + (yfrac >> yshift);
+		BYTE texdata = source[spot];
+		if (texdata != 0 || !masked)
+		{
+			*dest = BlendAdd (RGBAColor (palette, colormap[texdata]), *dest, fga, bga);
+		}
+		dest++;
+		xfrac += xstep;
+		yfrac += ystep;
+	} while (--count);
+}
+
+void R_DrawSpanTranslucent_RGBA (void)
+{
+	R_DrawSpanBlended_RGBA (false);
+}
+
+void R_DrawSpanMaskedTranslucent_RGBA (void)
+{
+	R_DrawSpanBlended_RGBA (true);
+}
+
+void R_DrawSpanAddClamp_RGBA (void)
+{
+	R_DrawSpanBlended_RGBA (false);
+}
+
+void R_DrawSpanMaskedAddClamp_RGBA (void)
+{
+	R_DrawSpanBlended_RGBA (true);
+}
+
+//==========================================================================
+//
+// Four columns from dc_temp
+//
+// Like the rt_ drawers in r_drawt.cpp, these copy four adjacent columns
+// that R_DrawColumnHoriz has stretched into dc_temp.
+//
+//==========================================================================
+
+void STACK_ARGS rt_map4cols_RGBA (int sx, int yl, int yh)
+{
+	int count = yh - yl + 1;
+	if (count <= 0)
+		return;
+
+	DWORD *dest = (DWORD *)dc_destorg + ylookup[yl] + sx;
+	const BYTE *source = &dc_temp[yl*4];
+	const PalEntry *palette = GPalette.BaseColors;
+	const BYTE *colormap = dc_colormap;
+	int pitch = dc_pitch;
+
+	do
+	{
+		dest[0] = RGBAColor (palette, colormap[source[0]]);
+		dest[1] = RGBAColor (palette, colormap[source[1]]);
+		dest[2] = RGBAColor (palette, colormap[source[2]]);
+		dest[3] = RGBAColor (palette, colormap[source[3]]);
+		source += 4;
+		dest += pitch;
+	} while (--count);
+}
+
+// rt_add4cols and rt_addclamp4cols only differ in whether the palettized
+// sum can overflow, which BlendAdd always clamps.
+static void rt_blend4cols_RGBA (int sx, int yl, int yh, bool subtract, bool reverse)
+{
+	int count = yh - yl + 1;
+	if (count <= 0)
+		return;
+
+	DWORD *dest = (DWORD *)dc_destorg + ylookup[yl] + sx;
+	const BYTE *source = &dc_temp[yl*4];
+	const PalEntry *palette = GPalette.BaseColors;
+	const BYTE *colormap = dc_colormap;
+	DWORD invert = dc_srcinvert;
+	int fga = dc_srcalpha >> 8;
+	int bga = dc_destalpha >> 8;
+	int pitch = dc_pitch;
+
+	do
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			DWORD fg = RGBAColor (palette, colormap[source[i]]) ^ invert;
+			if (!subtract)
+			{
+				dest[i] = BlendAdd (fg, dest[i], fga, bga);
+			}
+			else if (!reverse)
+			{
+				dest[i] = BlendSub (fg, dest[i], fga, bga);
+			}
+			else
+			{
+				dest[i] = BlendSub (dest[i], fg, bga, fga);
+			}
+		}
+		source += 4;
+		dest += pitch;
+	} while (--count);
+}
+
+void STACK_ARGS rt_add4cols_RGBA (int sx, int yl, int yh)
+{
+	rt_blend4cols_RGBA (sx, yl, yh, false, false);
+}
+
+void STACK_ARGS rt_addclamp4cols_RGBA (int sx, int yl, int yh)
+{
+	rt_blend4cols_RGBA (sx, yl, yh, false, false);
+}
+
+void STACK_ARGS rt_subclamp4cols_RGBA (int sx, int yl, int yh)
+{
+	rt_blend4cols_RGBA (sx, yl, yh, true, false);
+}
+
+void STACK_ARGS rt_revsubclamp4cols_RGBA (int sx, int yl, int yh)
+{
+	rt_blend4cols_RGBA (sx, yl, yh, true, true);
+}
@@ -0,0 +1,240 @@
+/*
+** r_drawt_sse2.cpp
+** SSE2 versions of the translucent column and span drawers
+**
+** The palette lookups cannot be vectorized, so the texels and the
+** Col2RGB8 values are still fetched one at a time. Everything between
+** those fetches and the final RGB32k lookup is done four pixels at once.
+** The tilted span drawer likewise steps the texture coordinates of four
+** pixels together and only does the texel and colormap lookups alone.
+** The results are bit-for-bit identical to the C versions in r_drawt.cpp
+** and r_draw.cpp.
+**
+*/
+
+#include "templates.h"
+#include "doomtype.h"
+#include "doomdef.h"
+#include "r_defs.h"
+#include "r_draw.h"
+#include "r_main.h"
+#include "v_video.h"
+#include "v_palette.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__i386__) || defined(__amd64__)
+
+#include <emmintrin.h>
+
+//==========================================================================
+//
+// Blending
+//
+// Each of these takes four fg2rgb and four bg2rgb values and returns the
+// four RGB32k indices for them.
+//
+//==========================================================================
+
+static inline __m128i BlendAdd (__m128i fg, __m128i bg)
+{
+	__m128i a = _mm_or_si128(_mm_add_epi32(fg, bg), _mm_set1_epi32(0x1f07c1f));
+	return _mm_and_si128(a, _mm_srli_epi32(a, 15));
+}
+
+static inline __m128i BlendAddClamp (__m128i fg, __m128i bg)
+{
+	__m128i a = _mm_add_epi32(fg, bg);
+	__m128i b = _mm_and_si128(a, _mm_set1_epi32(0x40100400));
+
+	a = _mm_or_si128(a, _mm_set1_epi32(0x01f07c1f));
+	a = _mm_and_si128(a, _mm_set1_epi32(0x3fffffff));
+	b = _mm_sub_epi32(b, _mm_srli_epi32(b, 5));
+	a = _mm_or_si128(a, b);
+	return _mm_and_si128(_mm_srli_epi32(a, 15), a);
+}
+
+// Computes (a | 0x40100400) - b with clamping, as used by both
+// subtraction styles.
+static inline __m128i BlendSubClamp (__m128i a, __m128i b)
+{
+	a = _mm_sub_epi32(_mm_or_si128(a, _mm_set1_epi32(0x40100400)), b);
+	b = _mm_and_si128(a, _mm_set1_epi32(0x40100400));
+	b = _mm_sub_epi32(b, _mm_srli_epi32(b, 5));
+	a = _mm_and_si128(a, b);
+	a = _mm_or_si128(a, _mm_set1_epi32(0x01f07c1f));
+	return _mm_and_si128(_mm_srli_epi32(a, 15), a);
+}
+
+static inline void StoreRGB32k (BYTE *dest, __m128i idx)
+{
+	int i[4];
+
+	_mm_storeu_si128((__m128i *)i, idx);
+	dest[0] = RGB32k.All[i[0]];
+	dest[1] = RGB32k.All[i[1]];
+	dest[2] = RGB32k.All[i[2]];
+	dest[3] = RGB32k.All[i[3]];
+}
+
+//==========================================================================
+//
+// Four column drawers
+//
+//==========================================================================
+
+#define RT_4COLS_SSE2(name, blend, fgarg, bgarg) \
+void STACK_ARGS name (int sx, int yl, int yh) \
+{ \
+	int count = yh - yl; \
+	if (count < 0) \
+		return; \
+	count++; \
+	\
+	const DWORD *fg2rgb = dc_srcblend; \
+	const DWORD *bg2rgb = dc_destblend; \
+	const BYTE *colormap = dc_colormap; \
+	BYTE *dest = ylookup[yl] + sx + dc_destorg; \
+	const BYTE *source = &dc_temp[yl*4]; \
+	int pitch = dc_pitch; \
+	\
+	do { \
+		__m128i fg = _mm_setr_epi32(fg2rgb[colormap[source[0]]], fg2rgb[colormap[source[1]]], \
+									fg2rgb[colormap[source[2]]], fg2rgb[colormap[source[3]]]); \
+		__m128i bg = _mm_setr_epi32(bg2rgb[dest[0]], bg2rgb[dest[1]], \
+									bg2rgb[dest[2]], bg2rgb[dest[3]]); \
+		StoreRGB32k(dest, blend(fgarg, bgarg)); \
+		source += 4; \
+		dest += pitch; \
+	} while (--count); \
+}
+
+RT_4COLS_SSE2(rt_add4cols_sse2, BlendAdd, fg, bg)
+RT_4COLS_SSE2(rt_addclamp4cols_sse2, BlendAddClamp, fg, bg)
+RT_4COLS_SSE2(rt_subclamp4cols_sse2, BlendSubClamp, fg, bg)
+RT_4COLS_SSE2(rt_revsubclamp4cols_sse2, BlendSubClamp, bg, fg)
+
+#undef RT_4COLS_SSE2
+
+//==========================================================================
+//
+// Span drawers
+//
+// The texture coordinates for four pixels are stepped together; the
+// 64x64 special case of the C drawers is just the general formula with
+// xbits == ybits == 6, so it needs no separate loop here.
+//
+//==========================================================================
+
+template<__m128i (*Blend)(__m128i, __m128i)>
+static void DrawSpanBlended_SSE2 ()
+{
+	const BYTE *source = ds_source;
+	const BYTE *colormap = ds_colormap;
+	const DWORD *fg2rgb = dc_srcblend;
+	const DWORD *bg2rgb = dc_destblend;
+	BYTE *dest = ylookup[ds_y] + ds_x1 + dc_destorg;
+	int count = ds_x2 - ds_x1 + 1;
+	dsfixed_t xfrac = ds_xfrac;
+	dsfixed_t yfrac = ds_yfrac;
+	dsfixed_t xstep = ds_xstep;
+	dsfixed_t ystep = ds_ystep;
+	BYTE yshift = 32 - ds_ybits;
+	BYTE xshift = yshift - ds_xbits;
+	int xmask = ((1 << ds_xbits) - 1) << ds_ybits;
+
+	if (count >= 4)
+	{
+		__m128i xf = _mm_setr_epi32(xfrac, xfrac + xstep, xfrac + xstep*2, xfrac + xstep*3);
+		__m128i yf = _mm_setr_epi32(yfrac, yfrac + ystep, yfrac + ystep*2, yfrac + ystep*3);
+		__m128i xs = _mm_set1_epi32(xstep*4);
+		__m128i ys = _mm_set1_epi32(ystep*4);
+		__m128i xsh = _mm_cvtsi32_si128(xshift);
+		__m128i ysh = _mm_cvtsi32_si128(yshift);
+		__m128i xm = _mm_set1_epi32(xmask);
+		int spot[4];
+
+		for (; count >= 4; count -= 4)
+		{
+			_mm_storeu_si128((__m128i *)spot, _mm_add_epi32(
+				_mm_and_si128(_mm_srl_epi32(xf, xsh), xm), _mm_srl_epi32(yf, ysh)));
+			__m128i fg = _mm_setr_epi32(fg2rgb[colormap[source[spot[0]]]], fg2rgb[colormap[source[spot[1]]]],
+										fg2rgb[colormap[source[spot[2]]]], fg2rgb[colormap[source[spot[3]]]]);
+			__m128i bg = _mm_setr_epi32(bg2rgb[dest[0]], bg2rgb[dest[1]], bg2rgb[dest[2]], bg2rgb[dest[3]]);
+			StoreRGB32k(dest, Blend(fg, bg));
+			dest += 4;
+			xf = _mm_add_epi32(xf, xs);
+			yf = _mm_add_epi32(yf, ys);
+		}
+		xfrac += xstep * (ds_x2 - ds_x1 + 1 - count);
+		yfrac += ystep * (ds_x2 - ds_x1 + 1 - count);
+	}
+	for (; count > 0; --count)
+	{
+		int spot = ((xfrac >> xshift) & xmask) + (yfrac >> yshift);
+		__m128i fg = _mm_cvtsi32_si128(fg2rgb[colormap[source[spot]]]);
+		__m128i bg = _mm_cvtsi32_si128(bg2rgb[*dest]);
+		*dest++ = RGB32k.All[_mm_cvtsi128_si32(Blend(fg, bg))];
+		xfrac += xstep;
+		yfrac += ystep;
+	}
+}
+
+void R_DrawSpanTranslucentP_SSE2 (void)
+{
+	DrawSpanBlended_SSE2<BlendAdd>();
+}
+
+void R_DrawSpanAddClampP_SSE2 (void)
+{
+	DrawSpanBlended_SSE2<BlendAddClamp>();
+}
+
+//==========================================================================
+//
+// Tilted span drawer
+//
+//==========================================================================
+
+void R_DrawTiltedSpanP_SSE2 (BYTE *dest, BYTE *const *lighting, int count, DWORD u, DWORD v, DWORD stepu, DWORD stepv)
+{
+	const BYTE *source = ds_source;
+	BYTE vshift = 32 - ds_ybits;
+	BYTE ushift = vshift - ds_xbits;
+	int umask = ((1 << ds_xbits) - 1) << ds_ybits;
+
+	if (count >= 4)
+	{
+		__m128i uu = _mm_setr_epi32(u, u + stepu, u + stepu*2, u + stepu*3);
+		__m128i vv = _mm_setr_epi32(v, v + stepv, v + stepv*2, v + stepv*3);
+		__m128i us = _mm_set1_epi32(stepu*4);
+		__m128i vs = _mm_set1_epi32(stepv*4);
+		__m128i ush = _mm_cvtsi32_si128(ushift);
+		__m128i vsh = _mm_cvtsi32_si128(vshift);
+		__m128i um = _mm_set1_epi32(umask);
+		int spot[4];
+		int done = count & ~3;
+
+		for (; count >= 4; count -= 4)
+		{
+			_mm_storeu_si128((__m128i *)spot, _mm_or_si128(
+				_mm_srl_epi32(vv, vsh), _mm_and_si128(_mm_srl_epi32(uu, ush), um)));
+			dest[0] = lighting[0][source[spot[0]]];
+			dest[1] = lighting[1][source[spot[1]]];
+			dest[2] = lighting[2][source[spot[2]]];
+			dest[3] = lighting[3][source[spot[3]]];
+			dest += 4;
+			lighting += 4;
+			uu = _mm_add_epi32(uu, us);
+			vv = _mm_add_epi32(vv, vs);
+		}
+		u += stepu * done;
+		v += stepv * done;
+	}
+	for (; count > 0; --count)
+	{
+		*dest++ = (*lighting++)[source[(v >> vshift) | ((u >> ushift) & umask)]];
+		u += stepu;
+		v += stepv;
+	}
+}
+
+#endif
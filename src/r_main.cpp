@@ -160,12 +160,18 @@ void (*hcolfunc_post1) (int hx, int sx, int yl, int yh);
 void (*hcolfunc_post2) (int hx, int sx, int yl, int yh);
 void (STACK_ARGS *hcolfunc_post4) (int sx, int yl, int yh);
 
-cycle_t WallCycles, PlaneCycles, MaskedCycles, WallScanCycles;
+cycle_t WallCycles, PlaneCycles, MaskedCycles, WallScanCycles, SkyBoxCycles;
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
 static int lastcenteryfrac;
 
+// The window R_RenderViewToCanvasScaled last set up, and the view size that
+// goes with it. Cleared by every other R_SetWindow.
+static bool ScaledWindowSet;
+static int ScaledBlocks, ScaledWidth, ScaledHeight, ScaledSTY;
+static int ScaledViewWidth, ScaledViewHeight, ScaledFreelookHeight;
+
 // CODE --------------------------------------------------------------------
 
 //==========================================================================
@@ -345,6 +351,8 @@ void R_SWRSetWindow(int windowSize, int fullWidth, int fullHeight, int stHeight,
 {
 	int virtheight, virtwidth, virtwidth2, virtheight2;
 
+	ScaledWindowSet = false;
+
 	if (!bRenderingToCanvas)
 	{ // Set r_viewsize cvar to reflect the current view size
 		UCVarValue value;
@@ -429,6 +437,24 @@ CUSTOM_CVAR (Int, r_columnmethod, 1, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 	}
 }
 
+//==========================================================================
+//
+// CVAR r_rendermode
+//
+// 0 renders palettized, 1 renders true color BGRA. Only canvases created
+// for it (see -benchrender) are BGRA; R_SetupBuffer picks the drawers to
+// match whatever canvas is being rendered to.
+//
+//==========================================================================
+
+CUSTOM_CVAR (Int, r_rendermode, 0, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0 || self > 1)
+	{
+		self = 0;
+	}
+}
+
 //==========================================================================
 //
 // R_Init
@@ -621,6 +647,17 @@ void R_SetupFreelook()
 CVAR(Int, r_portal_recursions, 4, CVAR_ARCHIVE)
 CVAR(Bool, r_highlight_portals, false, CVAR_ARCHIVE)
 
+// Portal statistics for the last view, shown by "stat portals"
+struct FPortalStat
+{
+	int Line;
+	int Depth;
+	double MS;		// not counting the portals seen through this one
+};
+static TArray<FPortalStat> PortalStats;
+static int PortalsCovered, PortalsAtLimit;
+static double PortalChildMS;
+
 void R_HighlightPortal (PortalDrawseg* pds)
 {
 	// [ZZ] NO OVERFLOW CHECKS HERE
@@ -685,9 +722,27 @@ void R_EnterPortal (PortalDrawseg* pds, int depth)
 		if (r_highlight_portals)
 			R_HighlightPortal(pds);
 
+		PortalsAtLimit++;
 		return;
 	}
 
+	// Skip portals that are completely covered by the walls around them.
+	// Nothing could be drawn through them anyway.
+	if (pds->wx1 >= pds->wx2)
+	{
+		if (r_highlight_portals)
+			R_HighlightPortal(pds);
+
+		PortalsCovered++;
+		return;
+	}
+
+	cycle_t portalcycles;
+	double savedchildms = PortalChildMS;
+	portalcycles.Reset();
+	portalcycles.Clock();
+	PortalChildMS = 0;
+
 	angle_t startang = viewangle;
 	fixed_t startx = viewx;
 	fixed_t starty = viewy;
@@ -776,11 +831,12 @@ void R_EnterPortal (PortalDrawseg* pds, int depth)
 	PortalDrawseg* prevpds = CurrentPortal;
 	CurrentPortal = pds;
 
+	// Only walk the BSP for the columns that can be seen through the portal.
 	R_ClearPlanes (false);
-	R_ClearClipSegs (pds->x1, pds->x2);
+	R_ClearClipSegs (pds->wx1, pds->wx2);
 
-	WindowLeft = pds->x1;
-	WindowRight = pds->x2;
+	WindowLeft = pds->wx1;
+	WindowRight = pds->wx2;
 	
 	// RF_XFLIP should be removed before calling the root function
 	int prevmf = MirrorFlags;
@@ -799,6 +855,13 @@ void R_EnterPortal (PortalDrawseg* pds, int depth)
 	memcpy (ceilingclip + pds->x1, &pds->ceilingclip[0], pds->len*sizeof(*ceilingclip));
 	memcpy (floorclip + pds->x1, &pds->floorclip[0], pds->len*sizeof(*floorclip));
 
+	// Columns closed off inside the window can go into the clip list right
+	// away, so that R_CheckBBox rejects the nodes behind them.
+	if (r_cullclosed)
+	{
+		R_AddClosedColumns (pds->wx1, pds->wx2);
+	}
+
 	InSubsector = NULL;
 	R_RenderBSPNode (nodes + numnodes - 1);
 	R_3D_ResetClip(); // reset clips (floor/ceiling)
@@ -806,7 +869,9 @@ void R_EnterPortal (PortalDrawseg* pds, int depth)
 
 	PlaneCycles.Clock();
 	R_DrawPlanes ();
+	SkyBoxCycles.Clock();
 	R_DrawSkyBoxes ();
+	SkyBoxCycles.Unclock();
 	PlaneCycles.Unclock();
 
 	fixed_t vzp = viewz;
@@ -845,6 +910,11 @@ void R_EnterPortal (PortalDrawseg* pds, int depth)
 	ViewPath[0] = savedpath[0];
 	ViewPath[1] = savedpath[1];
 	ViewAngle = AngleToFloat(viewangle);
+
+	portalcycles.Unclock();
+	FPortalStat stat = { int(pds->src - lines), depth, portalcycles.TimeMS() - PortalChildMS };
+	PortalStats.Push(stat);
+	PortalChildMS = savedchildms + portalcycles.TimeMS();
 }
 
 //==========================================================================
@@ -860,8 +930,21 @@ void R_SetupBuffer ()
 	static BYTE *lastbuff = NULL;
 
 	int pitch = RenderTarget->GetPitch();
-	BYTE *lineptr = RenderTarget->GetBuffer() + viewwindowy*pitch + viewwindowx;
+	int offset = viewwindowy*pitch + viewwindowx;
+	BYTE *lineptr = RenderTarget->GetBuffer() + (RenderTarget->IsBgra() ? offset*4 : offset);
 
+	if (RenderTarget->IsBgra() != r_drawbgra)
+	{
+		r_drawbgra = RenderTarget->IsBgra();
+		R_InitColumnDrawers ();
+		colfunc = basecolfunc = R_DrawColumn;
+		fuzzcolfunc = R_DrawFuzzColumn;
+		transcolfunc = R_DrawTranslatedColumn;
+		spanfunc = R_DrawSpan;
+		hcolfunc_pre = R_DrawColumnHoriz;
+		hcolfunc_post1 = rt_map1col;
+		hcolfunc_post4 = rt_map4cols;
+	}
 	if (dc_pitch != pitch || lineptr != lastbuff)
 	{
 		if (dc_pitch != pitch)
@@ -892,6 +975,10 @@ void R_RenderActorView (AActor *actor, bool dontmaplines)
 	PlaneCycles.Reset();
 	MaskedCycles.Reset();
 	WallScanCycles.Reset();
+	SkyBoxCycles.Reset();
+	PortalStats.Clear();
+	PortalsCovered = PortalsAtLimit = 0;
+	PortalChildMS = 0;
 
 	fakeActive = 0; // kg3D - reset fake floor indicator
 	R_3D_ResetClip(); // reset clips (floor/ceiling)
@@ -960,7 +1047,9 @@ void R_RenderActorView (AActor *actor, bool dontmaplines)
 	{
 		PlaneCycles.Clock();
 		R_DrawPlanes ();
+		SkyBoxCycles.Clock();
 		R_DrawSkyBoxes ();
+		SkyBoxCycles.Unclock();
 		PlaneCycles.Unclock();
 
 		// [RH] Walk through mirrors
@@ -1027,6 +1116,94 @@ void R_RenderViewToCanvas (AActor *actor, DCanvas *canvas,
 	viewactive = savedviewactive;
 }
 
+//==========================================================================
+//
+// R_RenderViewToCanvasScaled
+//
+// Renders the view into canvas as if the screen were scale times its real
+// size, keeping the current screenblocks and aspect ratio. The size of the
+// view that was drawn at the canvas's top left corner is returned in width
+// and height. Used for dynamic resolution.
+//
+// The renderer stays set up for the scaled window afterwards, and only the
+// view size and position are put back for the rest of the frame. Later
+// calls with the same size just swap them again, so R_SetWindow only runs
+// when the scale changes or something else set up a window in between.
+// R_UnscaleWindow must be called before drawing at the real size again.
+//
+// Pre: Canvas and screen are already locked.
+//
+//==========================================================================
+
+void R_RenderViewToCanvasScaled (AActor *actor, DCanvas *canvas, double scale, int &width, int &height)
+{
+	int savedwindowx = viewwindowx;
+	int savedwindowy = viewwindowy;
+	int savedwidth = viewwidth;
+	int savedheight = viewheight;
+	int savedfreelookheight = freelookviewheight;
+	int fullwidth = int(SCREENWIDTH * scale);
+	int fullheight = int(SCREENHEIGHT * scale);
+	int stheight = int(ST_Y * scale);
+
+	RenderTarget = canvas;
+	bRenderingToCanvas = true;
+
+	if (!ScaledWindowSet || ScaledBlocks != setblocks || ScaledWidth != fullwidth ||
+		ScaledHeight != fullheight || ScaledSTY != stheight)
+	{
+		R_SetWindow (setblocks, fullwidth, fullheight, stheight);
+		ScaledWindowSet = true;
+		ScaledBlocks = setblocks;
+		ScaledWidth = fullwidth;
+		ScaledHeight = fullheight;
+		ScaledSTY = stheight;
+		ScaledViewWidth = viewwidth;
+		ScaledViewHeight = viewheight;
+		ScaledFreelookHeight = freelookviewheight;
+	}
+	else
+	{
+		viewwidth = ScaledViewWidth;
+		viewheight = ScaledViewHeight;
+		freelookviewheight = ScaledFreelookHeight;
+		// The visibility may have been changed with the real view size in place.
+		R_SetVisibility (R_GetVisibility ());
+	}
+	viewwindowx = 0;
+	viewwindowy = 0;
+	width = viewwidth;
+	height = viewheight;
+
+	R_RenderActorView (actor);
+
+	RenderTarget = screen;
+	bRenderingToCanvas = false;
+	viewwidth = savedwidth;
+	viewheight = savedheight;
+	freelookviewheight = savedfreelookheight;
+	viewwindowx = savedwindowx;
+	viewwindowy = savedwindowy;
+	R_SetupBuffer ();
+}
+
+//==========================================================================
+//
+// R_UnscaleWindow
+//
+// Sets the renderer up for the real view size again if
+// R_RenderViewToCanvasScaled left it at a scaled one.
+//
+//==========================================================================
+
+void R_UnscaleWindow ()
+{
+	if (ScaledWindowSet)
+	{
+		R_SetWindow (setblocks, SCREENWIDTH, SCREENHEIGHT, ST_Y);
+	}
+}
+
 //==========================================================================
 //
 // R_MultiresInit
@@ -1077,6 +1254,51 @@ ADD_STAT (fps_accumulated)
 	return out;
 }
 
+//==========================================================================
+//
+// STAT portals
+//
+// Shows how many line portals and mirrors were drawn in the last view and
+// which of them took the longest. The time of a portal does not include
+// the portals seen through it.
+//
+//==========================================================================
+
+ADD_STAT (portals)
+{
+	FString out;
+	double total = 0;
+	int maxdepth = 0;
+	unsigned int slowest[3] = { ~0u, ~0u, ~0u };
+
+	for (unsigned int i = 0; i < PortalStats.Size(); ++i)
+	{
+		const FPortalStat &stat = PortalStats[i];
+		total += stat.MS;
+		maxdepth = MAX(maxdepth, stat.Depth + 1);
+		for (int j = 0; j < 3; ++j)
+		{
+			if (slowest[j] == ~0u || stat.MS > PortalStats[slowest[j]].MS)
+			{
+				for (int k = 2; k > j; --k)
+				{
+					slowest[k] = slowest[k-1];
+				}
+				slowest[j] = i;
+				break;
+			}
+		}
+	}
+	out.Format ("drawn=%u covered=%d at limit=%d depth=%d time=%.2f ms",
+		PortalStats.Size(), PortalsCovered, PortalsAtLimit, maxdepth, total);
+	for (int j = 0; j < 3 && slowest[j] != ~0u; ++j)
+	{
+		const FPortalStat &stat = PortalStats[slowest[j]];
+		out.AppendFormat ("\nline %d (depth %d): %.2f ms", stat.Line, stat.Depth, stat.MS);
+	}
+	return out;
+}
+
 //==========================================================================
 //
 // STAT wallcycles
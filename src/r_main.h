@@ -132,6 +132,8 @@ void R_RenderActorView (AActor *actor, bool dontmaplines = false);
 void R_SetupBuffer ();
 
 void R_RenderViewToCanvas (AActor *actor, DCanvas *canvas, int x, int y, int width, int height, bool dontmaplines = false);
+void R_RenderViewToCanvasScaled (AActor *actor, DCanvas *canvas, double scale, int &width, int &height);
+void R_UnscaleWindow ();
 
 // [RH] Initialize multires stuff for renderer
 void R_MultiresInit (void);
@@ -56,6 +56,10 @@
 #include "r_plane.h"
 #include "r_segs.h"
 #include "r_3dfloors.h"
+#include "r_thread.h"
+#include "m_crc32.h"
+#include "p_effect.h"
+#include "po_man.h"
 #include "v_palette.h"
 #include "r_data/colormaps.h"
 
@@ -84,6 +88,14 @@ static visplane_t		*visplanes[MAXVISPLANES+1];	// killough
 static visplane_t		*freetail;					// killough
 static visplane_t		**freehead = &freetail;		// killough
 
+// Visplanes are allocated in blocks instead of one at a time so that the
+// planes of a frame are close together in memory. Their top and bottom
+// arrays are sized for the widest view rendered so far instead of MAXWIDTH,
+// which cuts their size to a fraction for most screen modes.
+#define VISPLANE_BLOCK 32
+static TArray<BYTE *>	VisplaneBlocks;
+static int				VisplaneWidth;
+
 visplane_t 				*floorplane;
 visplane_t 				*ceilingplane;
 
@@ -154,6 +166,12 @@ extern "C" void R_SetTiltedSpanSource_ASM (const BYTE *flat);
 extern "C" BYTE *ds_curcolormap, *ds_cursource, *ds_curtiltedsource;
 #endif
 void					R_DrawSinglePlane (visplane_t *, fixed_t alpha, bool additive, bool masked);
+static void				R_FreeVisplanes ();
+
+// Opaque flat spans are collected here while R_DrawPlanes is running with
+// more than one render thread and drawn in one go by R_FlushSpanQueue.
+static TArray<FDrawSpanArgs> SpanQueue;
+static bool				QueueSpans;
 
 //==========================================================================
 //
@@ -178,18 +196,53 @@ void R_DeinitPlanes ()
 	fakeActive = 0;
 
 	// do not use R_ClearPlanes because at this point the screen pointer is no longer valid.
-	for (int i = 0; i <= MAXVISPLANES; i++)	// new code -- killough
+	R_FreeVisplanes ();
+}
+
+//==========================================================================
+//
+// R_FreeVisplanes
+//
+// Releases every visplane, including the ones still in use.
+//
+//==========================================================================
+
+static void R_FreeVisplanes ()
+{
+	for (unsigned i = 0; i < VisplaneBlocks.Size(); ++i)
 	{
-		for (*freehead = visplanes[i], visplanes[i] = NULL; *freehead; )
-		{
-			freehead = &(*freehead)->next;
-		}
+		M_Free (VisplaneBlocks[i]);
 	}
-	for (visplane_t *pl = freetail; pl != NULL; )
+	VisplaneBlocks.Clear ();
+	for (int i = 0; i <= MAXVISPLANES; i++)
+	{
+		visplanes[i] = NULL;
+	}
+	freetail = NULL;
+	freehead = &freetail;
+}
+
+//==========================================================================
+//
+// R_AllocVisplaneBlock
+//
+// Adds VISPLANE_BLOCK new visplanes to the end of the free list.
+//
+//==========================================================================
+
+static void R_AllocVisplaneBlock ()
+{
+	size_t size = (sizeof(visplane_t) + sizeof(unsigned short)*(VisplaneWidth+2)*2 + 15) & ~15;
+	BYTE *block = (BYTE *)M_Malloc (size * VISPLANE_BLOCK);
+
+	memset (block, 0, size * VISPLANE_BLOCK);
+	VisplaneBlocks.Push (block);
+	for (int i = 0; i < VISPLANE_BLOCK; ++i)
 	{
-		visplane_t *next = pl->next;
-		free (pl);
-		pl = next;
+		visplane_t *pl = (visplane_t *)(block + i * size);
+		pl->bottom = pl->top + VisplaneWidth + 2;
+		*freehead = pl;
+		freehead = &pl->next;
 	}
 }
 
@@ -236,6 +289,27 @@ void R_MapPlane (int y, int x1)
 		R_SetSpanColormap_ASM (ds_colormap);
 #endif
 
+	if (QueueSpans)
+	{
+		if (spanfunc == R_DrawSpan)
+		{
+			FDrawSpanArgs &span = SpanQueue[SpanQueue.Reserve(1)];
+			span.dest = ylookup[y] + x1 + dc_destorg;
+			span.source = ds_source;
+			span.colormap = ds_colormap;
+			span.xfrac = ds_xfrac;
+			span.yfrac = ds_yfrac;
+			span.xstep = ds_xstep;
+			span.ystep = ds_ystep;
+			span.count = x2 - x1 + 1;
+			span.y = y;
+			span.xbits = ds_xbits;
+			span.ybits = ds_ybits;
+			return;
+		}
+		R_FlushSpanQueue ();
+	}
+
 	ds_y = y;
 	ds_x1 = x1;
 	ds_x2 = x2;
@@ -243,6 +317,36 @@ void R_MapPlane (int y, int x1)
 	spanfunc ();
 }
 
+//==========================================================================
+//
+// R_FlushSpanQueue
+//
+// Draws all queued spans. Every slice takes care of every n-th row, so
+// the threads never write to the same pixels, and spans that share a row
+// are still drawn in the order they were queued.
+//
+//==========================================================================
+
+static void R_DrawQueuedSpans (int slice, int numslices, void *)
+{
+	for (unsigned i = 0; i < SpanQueue.Size(); ++i)
+	{
+		if (SpanQueue[i].y % numslices == slice)
+		{
+			R_DrawSpanArgs (SpanQueue[i]);
+		}
+	}
+}
+
+void R_FlushSpanQueue ()
+{
+	if (SpanQueue.Size() > 0)
+	{
+		R_RunSliced (R_DrawQueuedSpans, NULL);
+		SpanQueue.Clear();
+	}
+}
+
 //==========================================================================
 //
 // R_CalcTiltedLighting
@@ -349,6 +453,51 @@ void STACK_ARGS R_CalcTiltedLighting (fixed_t lval, fixed_t lend, int width)
 }
 }	// extern "C"
 
+//==========================================================================
+//
+// R_TiltedSpanSize
+//
+// Rows of tilted planes are drawn as a series of affine pieces. This
+// returns how long the pieces of a row can be for the texture coordinates
+// to stay within r_tilterror texels of the correct ones.
+//
+// Along a row, u = uz/iz with both uz and iz linear in x, so the second
+// derivative of u is 2*dz*K/iz^3 for a constant K. The error of a piece
+// n pixels long is at most n^2/8 times that, and it is largest at the end
+// of the row where iz is smallest.
+//
+//==========================================================================
+
+#define SPANSIZE		16		// Used when r_tilterror is 0
+#define MIN_TILTSPAN	4
+#define MAX_TILTSPAN	128
+
+CUSTOM_CVAR (Float, r_tilterror, 0.f, CVAR_ARCHIVE)
+{
+	if (self < 0)
+	{
+		self = 0.f;
+	}
+}
+
+static int R_TiltedSpanSize (double iz, double uz, double vz, int width)
+{
+	double izend = iz + plane_sz[0] * width;
+	double zmin = MIN (fabs(iz), fabs(izend));
+
+	// K for u and v, scaled to texels
+	double ku = fabs(ldexp (plane_su[0] * iz - uz * plane_sz[0], ds_xbits - 32));
+	double kv = fabs(ldexp (plane_sv[0] * iz - vz * plane_sz[0], ds_ybits - 32));
+	double k = fabs(plane_sz[0]) * MAX (ku, kv);
+
+	if (k <= 0)
+	{
+		return MAX_TILTSPAN;
+	}
+	double n = sqrt (4 * r_tilterror * zmin * zmin * zmin / k);
+	return (int)clamp<double> (n, MIN_TILTSPAN, MAX_TILTSPAN);
+}
+
 //==========================================================================
 //
 // R_MapTiltedPlane
@@ -362,7 +511,6 @@ void R_MapTiltedPlane (int y, int x1)
 	double iz, uz, vz;
 	BYTE *fb;
 	DWORD u, v;
-	int i;
 
 	iz = plane_sz[2] + plane_sz[1]*(centery-y) + plane_sz[0]*(x1-centerx);
 
@@ -385,7 +533,7 @@ void R_MapTiltedPlane (int y, int x1)
 
 #if 0		// The "perfect" reference version of this routine. Pretty slow.
 			// Use it only to see how things are supposed to look.
-	i = 0;
+	int i = 0;
 	do
 	{
 		double z = 1.f/iz;
@@ -399,25 +547,25 @@ void R_MapTiltedPlane (int y, int x1)
 		vz += plane_sv[0];
 	} while (--width >= 0);
 #else
-//#define SPANSIZE 32
-//#define INVSPAN 0.03125f
-//#define SPANSIZE 8
-//#define INVSPAN 0.125f
-#define SPANSIZE 16
-#define INVSPAN	0.0625f
+	int spansize = SPANSIZE;
+	if (r_tilterror > 0)
+	{
+		spansize = R_TiltedSpanSize (iz, uz, vz, width);
+	}
 
 	double startz = 1.f/iz;
 	double startu = uz*startz;
 	double startv = vz*startz;
 	double izstep, uzstep, vzstep;
+	double invspan = 1. / spansize;
 
-	izstep = plane_sz[0] * SPANSIZE;
-	uzstep = plane_su[0] * SPANSIZE;
-	vzstep = plane_sv[0] * SPANSIZE;
+	izstep = plane_sz[0] * spansize;
+	uzstep = plane_su[0] * spansize;
+	vzstep = plane_sv[0] * spansize;
 	x1 = 0;
 	width++;
 
-	while (width >= SPANSIZE)
+	while (width >= spansize)
 	{
 		iz += izstep;
 		uz += uzstep;
@@ -426,21 +574,16 @@ void R_MapTiltedPlane (int y, int x1)
 		double endz = 1.f/iz;
 		double endu = uz*endz;
 		double endv = vz*endz;
-		DWORD stepu = SQWORD((endu - startu) * INVSPAN);
-		DWORD stepv = SQWORD((endv - startv) * INVSPAN);
+		DWORD stepu = SQWORD((endu - startu) * invspan);
+		DWORD stepv = SQWORD((endv - startv) * invspan);
 		u = SQWORD(startu) + pviewx;
 		v = SQWORD(startv) + pviewy;
 
-		for (i = SPANSIZE-1; i >= 0; i--)
-		{
-			fb[x1] = *(tiltlighting[x1] + ds_source[(v >> vshift) | ((u >> ushift) & umask)]);
-			x1++;
-			u += stepu;
-			v += stepv;
-		}
+		R_DrawTiltedSpan (fb + x1, tiltlighting + x1, spansize, u, v, stepu, stepv);
+		x1 += spansize;
 		startu = endu;
 		startv = endv;
-		width -= SPANSIZE;
+		width -= spansize;
 	}
 	if (width > 0)
 	{
@@ -466,13 +609,7 @@ void R_MapTiltedPlane (int y, int x1)
 			u = SQWORD(startu) + pviewx;
 			v = SQWORD(startv) + pviewy;
 
-			for (; width != 0; width--)
-			{
-				fb[x1] = *(tiltlighting[x1] + ds_source[(v >> vshift) | ((u >> ushift) & umask)]);
-				x1++;
-				u += stepu;
-				v += stepv;
-			}
+			R_DrawTiltedSpan (fb + x1, tiltlighting + x1, width, u, v, stepu, stepv);
 		}
 	}
 #endif
@@ -533,6 +670,14 @@ void R_ClearPlanes (bool fullclear)
 			}
 		}
 
+		// Every plane is free now, so this is the time to make them wider
+		// if the view has grown.
+		if (viewwidth > VisplaneWidth)
+		{
+			R_FreeVisplanes ();
+			VisplaneWidth = viewwidth;
+		}
+
 		// opening / clipping determination
 		clearbufshort (floorclip, viewwidth, viewheight);
 		// [RH] clip ceiling to console bottom
@@ -555,15 +700,13 @@ void R_ClearPlanes (bool fullclear)
 
 static visplane_t *new_visplane (unsigned hash)
 {
-	visplane_t *check = freetail;
-
-	if (check == NULL)
+	if (freetail == NULL)
 	{
-		check = (visplane_t *)M_Malloc (sizeof(*check) + 3 + sizeof(*check->top)*(MAXWIDTH*2));
-		memset(check, 0, sizeof(*check) + 3 + sizeof(*check->top)*(MAXWIDTH*2));
-		check->bottom = check->top + MAXWIDTH+2;
+		R_AllocVisplaneBlock ();
 	}
-	else if (NULL == (freetail = freetail->next))
+
+	visplane_t *check = freetail;
+	if (NULL == (freetail = freetail->next))
 	{
 		freehead = &freetail;
 	}
@@ -868,37 +1011,103 @@ static BYTE skybuf[4][512];
 static DWORD lastskycol[4];
 static int skycolplace;
 
-// Get a column of sky when there is only one sky texture.
-static const BYTE *R_GetOneSkyColumn (FTexture *fronttex, int x)
+// The sky texture column for every screen column. This only depends on the
+// view angle, the field of view and the sky's position, so it is kept until
+// one of those changes.
+static DWORD skyfrontcols[MAXWIDTH+1], skybackcols[MAXWIDTH+1];
+static struct
+{
+	angle_t Angle, Flip;
+	fixed_t FrontCyl, BackCyl;
+	int FrontPos, BackPos;
+	int Width;
+	fixed_t CenterX, FocalLength;
+	bool HasBack;
+} skycolkey;
+
+// Composited columns of a double sky, so that they do not have to be
+// built again every frame while the view does not turn. Warped and
+// camera textures change on their own and are not cached.
+static FTexture *skycachefront, *skycacheback;
+static TMap<DWORD, int> skycache;		// column pair -> offset in skycachedata
+static TArray<BYTE> skycachedata;
+static int skycacheused, skycachesize, skycacheheight;
+static bool skycacheon;
+
+static void R_UpdateSkyColumns ()
 {
-	angle_t column = (skyangle + xtoviewangle[x]) ^ skyflip;
-	return fronttex->GetColumn((UMulScale16(column, frontcyl) + frontpos) >> FRACBITS, NULL);
+	bool hasback = backskytex != NULL;
+
+	if (skycolkey.Angle == skyangle && skycolkey.Flip == skyflip &&
+		skycolkey.FrontCyl == frontcyl && skycolkey.FrontPos == frontpos &&
+		skycolkey.HasBack == hasback && (!hasback || (skycolkey.BackCyl == backcyl && skycolkey.BackPos == backpos)) &&
+		skycolkey.Width == viewwidth && skycolkey.CenterX == centerxfrac && skycolkey.FocalLength == FocalLengthX)
+	{
+		return;
+	}
+	skycolkey.Angle = skyangle;
+	skycolkey.Flip = skyflip;
+	skycolkey.FrontCyl = frontcyl;
+	skycolkey.FrontPos = frontpos;
+	skycolkey.BackCyl = backcyl;
+	skycolkey.BackPos = backpos;
+	skycolkey.HasBack = hasback;
+	skycolkey.Width = viewwidth;
+	skycolkey.CenterX = centerxfrac;
+	skycolkey.FocalLength = FocalLengthX;
+
+	for (int x = 0; x <= viewwidth; ++x)
+	{
+		angle_t ang = (skyangle + xtoviewangle[x]) ^ skyflip;
+		skyfrontcols[x] = (UMulScale16(ang, frontcyl) + frontpos) >> FRACBITS;
+		if (hasback)
+		{
+			skybackcols[x] = (UMulScale16(ang, backcyl) + backpos) >> FRACBITS;
+		}
+	}
 }
 
-// Get a column of sky when there are two overlapping sky textures
-static const BYTE *R_GetTwoSkyColumns (FTexture *fronttex, int x)
+// Makes sure the double sky cache belongs to the current textures and has
+// room for another count columns.
+static void R_PrepareSkyCache (int count)
 {
-	DWORD ang = (skyangle + xtoviewangle[x]) ^ skyflip;
-	DWORD angle1 = (DWORD)((UMulScale16(ang, frontcyl) + frontpos) >> FRACBITS);
-	DWORD angle2 = (DWORD)((UMulScale16(ang, backcyl) + backpos) >> FRACBITS);
+	skycacheon = backskytex != NULL &&
+		!frontskytex->bWarped && !frontskytex->bHasCanvas &&
+		!backskytex->bWarped && !backskytex->bHasCanvas;
+	if (!skycacheon)
+	{
+		return;
+	}
 
-	// Check if this column has already been built. If so, there's
-	// no reason to waste time building it again.
-	DWORD skycol = (angle1 << 16) | angle2;
-	int i;
+	int height = MIN<int> (512, MIN (backskytex->GetHeight(), frontskytex->GetHeight()));
+	int size = MAX (viewwidth, 320) * 2;
 
-	for (i = 0; i < 4; ++i)
+	if (skycachefront != frontskytex || skycacheback != backskytex ||
+		skycacheheight != height || skycachesize < size || skycacheused + count > skycachesize)
 	{
-		if (lastskycol[i] == skycol)
+		skycachefront = frontskytex;
+		skycacheback = backskytex;
+		skycacheheight = height;
+		skycachesize = MAX (skycachesize, size);
+		// Every column gets the full 512 bytes of a skybuf, because the
+		// drawers may read past the composited part just like they do there.
+		if (skycachedata.Size() < unsigned(skycachesize * 512))
 		{
-			return skybuf[i];
+			skycachedata.Resize (skycachesize * 512);
 		}
+		skycache.Clear();
+		skycacheused = 0;
 	}
+}
 
-	lastskycol[skycolplace] = skycol;
-	BYTE *composite = skybuf[skycolplace];
-	skycolplace = (skycolplace + 1) & 3;
+// Get a column of sky when there is only one sky texture.
+static const BYTE *R_GetOneSkyColumn (FTexture *fronttex, int x)
+{
+	return fronttex->GetColumn(skyfrontcols[x], NULL);
+}
 
+static void R_CompositeSkyColumn (BYTE *composite, FTexture *fronttex, DWORD angle1, DWORD angle2)
+{
 	// The ordering of the following code has been tuned to allow VC++ to optimize
 	// it well. In particular, this arrangement lets it keep count in a register
 	// instead of on the stack.
@@ -906,7 +1115,7 @@ static const BYTE *R_GetTwoSkyColumns (FTexture *fronttex, int x)
 	const BYTE *back = backskytex->GetColumn (angle2, NULL);
 
 	int count = MIN<int> (512, MIN (backskytex->GetHeight(), fronttex->GetHeight()));
-	i = 0;
+	int i = 0;
 	do
 	{
 		if (front[i])
@@ -918,6 +1127,46 @@ static const BYTE *R_GetTwoSkyColumns (FTexture *fronttex, int x)
 			composite[i] = back[i];
 		}
 	} while (++i, --count);
+}
+
+// Get a column of sky when there are two overlapping sky textures
+static const BYTE *R_GetTwoSkyColumns (FTexture *fronttex, int x)
+{
+	DWORD angle1 = skyfrontcols[x];
+	DWORD angle2 = skybackcols[x];
+
+	// Check if this column has already been built. If so, there's
+	// no reason to waste time building it again.
+	DWORD skycol = (angle1 << 16) | angle2;
+	int i;
+
+	if (skycacheon && angle1 < 0x10000 && angle2 < 0x10000)
+	{
+		int *ofs = skycache.CheckKey (skycol);
+		if (ofs != NULL)
+		{
+			return &skycachedata[*ofs];
+		}
+		BYTE *composite = &skycachedata[skycacheused * 512];
+		skycache[skycol] = skycacheused * 512;
+		skycacheused++;
+		R_CompositeSkyColumn (composite, fronttex, angle1, angle2);
+		return composite;
+	}
+
+	for (i = 0; i < 4; ++i)
+	{
+		if (lastskycol[i] == skycol)
+		{
+			return skybuf[i];
+		}
+	}
+
+	lastskycol[skycolplace] = skycol;
+	BYTE *composite = skybuf[skycolplace];
+	skycolplace = (skycolplace + 1) & 3;
+
+	R_CompositeSkyColumn (composite, fronttex, angle1, angle2);
 	return composite;
 }
 
@@ -951,6 +1200,8 @@ static void R_DrawSky (visplane_t *pl)
 	{
 		lastskycol[x] = 0xffffffff;
 	}
+	R_UpdateSkyColumns ();
+	R_PrepareSkyCache (pl->right - pl->left);
 
 	rw_pic = frontskytex;
 	rw_offset = 0;
@@ -1041,6 +1292,8 @@ int R_DrawPlanes ()
 	int vpcount = 0;
 
 	ds_color = 3;
+	// Queued spans are drawn by the palettized R_DrawSpanArgs.
+	QueueSpans = R_GetSliceCount() > 1 && !r_drawbgra;
 
 	for (i = 0; i < MAXVISPLANES; i++)
 	{
@@ -1056,6 +1309,8 @@ int R_DrawPlanes ()
 			}
 		}
 	}
+	R_FlushSpanQueue ();
+	QueueSpans = false;
 	return vpcount;
 }
 
@@ -1112,11 +1367,13 @@ void R_DrawSinglePlane (visplane_t *pl, fixed_t alpha, bool additive, bool maske
 
 	if (r_drawflat)
 	{ // [RH] no texture mapping
+		R_FlushSpanQueue ();
 		ds_color += 4;
 		R_MapVisPlane (pl, R_MapColoredPlane);
 	}
 	else if (pl->picnum == skyflatnum)
 	{ // sky flat
+		R_FlushSpanQueue ();
 		R_DrawSkyPlane (pl);
 	}
 	else
@@ -1150,12 +1407,552 @@ void R_DrawSinglePlane (visplane_t *pl, fixed_t alpha, bool additive, bool maske
 		}
 		else
 		{
+			R_FlushSpanQueue ();
 			R_DrawTiltedPlane (pl, alpha, additive, masked);
 		}
 	}
 	NetUpdate ();
 }
 
+//==========================================================================
+//
+// Skybox cache
+//
+// A skybox whose viewpoint does not move looks exactly the same every frame
+// as long as the view direction and everything inside the skybox stay the
+// same. Once that has been true for a few frames in a row, the skybox is
+// drawn for the whole view into a buffer of its own, and later frames copy
+// the parts they need from there instead of walking the BSP again.
+//
+// "Everything inside the skybox" is a hash of the subsectors that were
+// drawn the last time: their sectors, walls, decals, polyobjects, things
+// and particles. Any change to one of them makes the next frame draw the
+// skybox normally again.
+//
+// Nothing but comparing the view is done while the view keeps changing,
+// and a skybox whose contents changed waits as long again before they are
+// hashed the next time, so that a player who keeps turning, or a skybox
+// that is always moving, costs about the same as without the cache.
+//
+//==========================================================================
+
+CVAR (Bool, r_skyboxcache, true, CVAR_ARCHIVE)
+
+#define MAX_CACHED_SKYBOXES		4
+#define SKYBOX_WAIT_FRAMES		3		// Frames with the same view before the cache is used
+
+enum ESkyboxCacheState
+{
+	SKYCACHE_Skip,						// Draw normally
+	SKYCACHE_Record,					// Draw normally and remember what was drawn
+	SKYCACHE_Use,						// Nothing changed since it was remembered
+};
+
+// Everything about the view a skybox is drawn with. This is compared with
+// memcmp, so it is always cleared before filling it in.
+struct FSkyboxView
+{
+	fixed_t X, Y, Z;
+	angle_t Angle;
+	int ViewPitch;
+	int CenterY;
+	fixed_t FocalLengthX, FocalLengthY;
+	int Width, Height, BufferPitch;
+	int Mirror;
+	float Visibility;
+	int ExtraLight;
+	lighttable_t *FixedColormap;
+	int FixedLight;
+	double SkyPos[2];
+};
+
+struct FSkyboxCache
+{
+	ASkyViewpoint *Sky;
+	FSkyboxView View;
+	DWORD Signature;					// Hash of everything in Subsectors
+	TArray<subsector_t *> Subsectors;	// Drawn by the last frame that showed this skybox
+	TArray<BYTE> Pixels;				// The whole view, viewheight rows of dc_pitch bytes
+	int LastUsed;
+	int CheckedFrame;					// The SkyboxFrame State is for
+	int Stable;							// Frames in a row with the same View
+	ESkyboxCacheState State;
+	bool Valid;							// Pixels match View and Signature
+	bool Fresh;							// Pixels are being drawn by this R_DrawSkyBoxes call
+	bool Portals;						// There are portals inside the skybox, so never use Pixels
+};
+
+static FSkyboxCache SkyboxCache[MAX_CACHED_SKYBOXES];
+static TArray<subsector_t *> SkyboxSubsectors;
+static int SkyboxFrame;
+
+//==========================================================================
+//
+// R_ClearSkyboxCache
+//
+// Must be called when the level goes away, because the cache holds
+// pointers into it.
+//
+//==========================================================================
+
+void R_ClearSkyboxCache ()
+{
+	for (int i = 0; i < MAX_CACHED_SKYBOXES; ++i)
+	{
+		FSkyboxCache *cache = &SkyboxCache[i];
+
+		cache->Sky = NULL;
+		cache->Subsectors.Clear ();
+		cache->Pixels.Clear ();
+		cache->LastUsed = cache->CheckedFrame = cache->Stable = 0;
+		cache->State = SKYCACHE_Skip;
+		cache->Valid = cache->Fresh = cache->Portals = false;
+	}
+}
+
+//==========================================================================
+//
+// R_FindSkyboxCache
+//
+// Returns NULL if the skybox is already being drawn into its cache by
+// another visplane.
+//
+//==========================================================================
+
+static FSkyboxCache *R_FindSkyboxCache (ASkyViewpoint *sky)
+{
+	FSkyboxCache *oldest = &SkyboxCache[0];
+
+	for (int i = 0; i < MAX_CACHED_SKYBOXES; ++i)
+	{
+		FSkyboxCache *cache = &SkyboxCache[i];
+
+		if (cache->Sky == sky)
+		{
+			if (cache->Fresh)
+			{
+				return NULL;
+			}
+			cache->LastUsed = SkyboxFrame;
+			return cache;
+		}
+		if (cache->LastUsed < oldest->LastUsed)
+		{
+			oldest = cache;
+		}
+	}
+	if (oldest->LastUsed == SkyboxFrame)
+	{
+		return NULL;
+	}
+	oldest->Sky = sky;
+	oldest->Subsectors.Clear ();
+	oldest->LastUsed = SkyboxFrame;
+	oldest->CheckedFrame = oldest->Stable = 0;
+	oldest->State = SKYCACHE_Skip;
+	oldest->Valid = oldest->Fresh = oldest->Portals = false;
+	return oldest;
+}
+
+//==========================================================================
+//
+// R_GetSkyboxView
+//
+//==========================================================================
+
+static void R_GetSkyboxView (FSkyboxView &view)
+{
+	memset (&view, 0, sizeof(view));
+	view.X = viewx;
+	view.Y = viewy;
+	view.Z = viewz;
+	view.Angle = viewangle;
+	view.ViewPitch = viewpitch;
+	view.CenterY = centery;
+	view.FocalLengthX = FocalLengthX;
+	view.FocalLengthY = FocalLengthY;
+	view.Width = viewwidth;
+	view.Height = viewheight;
+	view.BufferPitch = dc_pitch;
+	view.Mirror = MirrorFlags;
+	view.Visibility = R_GetVisibility ();
+	view.ExtraLight = r_actualextralight;
+	view.FixedColormap = fixedcolormap;
+	view.FixedLight = fixedlightlev;
+	view.SkyPos[0] = sky1pos;
+	view.SkyPos[1] = sky2pos;
+}
+
+//==========================================================================
+//
+// Skybox content hashing
+//
+//==========================================================================
+
+template<class T> static inline DWORD HashOf (DWORD crc, const T &val)
+{
+	return AddCRC32 (crc, (const BYTE *)&val, sizeof(val));
+}
+
+static DWORD HashTexture (DWORD crc, FTextureID texnum)
+{
+	FTexture *tex = TexMan(texnum, true);
+
+	crc = HashOf (crc, tex);
+	// Camera and warped textures change their pixels on their own, so
+	// anything showing them can never be taken from the cache.
+	if (tex != NULL && (tex->bHasCanvas || tex->bWarped))
+	{
+		crc = HashOf (crc, validcount);
+	}
+	return crc;
+}
+
+static DWORD HashSide (DWORD crc, const side_t *side);
+
+// The sky flat only stands for the real sky textures, which R_DrawSkyPlane
+// picks the same way as here.
+static DWORD HashSky (DWORD crc, int sky)
+{
+	crc = HashTexture (crc, sky1texture);
+	crc = HashTexture (crc, sky2texture);
+	crc = HashOf (crc, sky);
+	if ((sky & PL_SKYFLAT) && sky != PL_SKYFLAT)
+	{
+		const line_t *l = &lines[(sky & ~PL_SKYFLAT)-1];
+
+		crc = HashSide (crc, l->sidedef[0]);
+		crc = HashOf (crc, l->args[2]);
+	}
+	return crc;
+}
+
+static DWORD HashSector (DWORD crc, const sector_t *sec)
+{
+	crc = HashOf (crc, sec->floorplane);
+	crc = HashOf (crc, sec->ceilingplane);
+	crc = HashOf (crc, sec->planes);
+	crc = HashOf (crc, sec->lightlevel);
+	crc = HashOf (crc, sec->ColorMap);
+	crc = HashTexture (crc, sec->GetTexture(sector_t::floor));
+	crc = HashTexture (crc, sec->GetTexture(sector_t::ceiling));
+	if (sec->GetTexture(sector_t::floor) == skyflatnum || sec->GetTexture(sector_t::ceiling) == skyflatnum)
+	{
+		crc = HashSky (crc, sec->sky);
+	}
+	return crc;
+}
+
+static DWORD HashSide (DWORD crc, const side_t *side)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		crc = HashOf (crc, side->textures[i].xoffset);
+		crc = HashOf (crc, side->textures[i].yoffset);
+		crc = HashOf (crc, side->textures[i].xscale);
+		crc = HashOf (crc, side->textures[i].yscale);
+		crc = HashTexture (crc, side->textures[i].texture);
+	}
+	for (const DBaseDecal *decal = side->AttachedDecals; decal != NULL; decal = decal->WallNext)
+	{
+		crc = HashOf (crc, decal);
+		crc = HashOf (crc, decal->LeftDistance);
+		crc = HashOf (crc, decal->Z);
+		crc = HashOf (crc, decal->ScaleX);
+		crc = HashOf (crc, decal->ScaleY);
+		crc = HashOf (crc, decal->Alpha);
+		crc = HashOf (crc, decal->AlphaColor);
+		crc = HashOf (crc, decal->Translation);
+		crc = HashOf (crc, decal->RenderFlags);
+		crc = HashOf (crc, decal->RenderStyle.AsDWORD);
+		crc = HashTexture (crc, decal->PicNum);
+	}
+	crc = HashOf (crc, side->Light);
+	crc = HashOf (crc, side->Flags);
+	crc = HashOf (crc, side->linedef->Alpha);
+	crc = HashOf (crc, side->linedef->flags);
+	return crc;
+}
+
+static DWORD HashThing (DWORD crc, AActor *thing)
+{
+	crc = HashOf (crc, thing->InterpolatedPosition (r_TicFracF));
+	crc = HashOf (crc, thing->Angles.Yaw);
+	crc = HashOf (crc, thing->sprite);
+	crc = HashOf (crc, thing->frame);
+	crc = HashOf (crc, thing->picnum);
+	crc = HashOf (crc, thing->Scale);
+	crc = HashOf (crc, thing->RenderStyle.AsDWORD);
+	crc = HashOf (crc, thing->renderflags);
+	crc = HashOf (crc, thing->flags);
+	crc = HashOf (crc, thing->flags2);
+	crc = HashOf (crc, thing->Alpha);
+	crc = HashOf (crc, thing->fillcolor);
+	crc = HashOf (crc, thing->Translation);
+	crc = HashOf (crc, thing->Floorclip);
+	// Fuzz moves every frame.
+	if (thing->RenderStyle == LegacyRenderStyles[STYLE_Fuzzy] ||
+		thing->RenderStyle == LegacyRenderStyles[STYLE_OptFuzzy])
+	{
+		crc = HashOf (crc, validcount);
+	}
+	return crc;
+}
+
+static DWORD R_HashSkyboxContents (const TArray<subsector_t *> &subs)
+{
+	DWORD crc = 0;
+
+	validcount++;	// Each sector's things are only hashed once
+	for (unsigned i = 0; i < subs.Size(); ++i)
+	{
+		subsector_t *sub = subs[i];
+		sector_t *sec = sub->sector;
+
+		crc = HashSector (crc, sec);
+		if (sec->heightsec != NULL)
+		{
+			crc = HashSector (crc, sec->heightsec);
+		}
+		for (unsigned j = 0; j < sec->e->XFloor.ffloors.Size(); ++j)
+		{
+			F3DFloor *rover = sec->e->XFloor.ffloors[j];
+
+			crc = HashOf (crc, rover->flags);
+			crc = HashOf (crc, rover->alpha);
+			crc = HashOf (crc, *rover->top.plane);
+			crc = HashOf (crc, *rover->bottom.plane);
+			crc = HashTexture (crc, *rover->top.texture);
+			crc = HashTexture (crc, *rover->bottom.texture);
+			if (rover->toplightlevel != NULL)
+			{
+				crc = HashOf (crc, *rover->toplightlevel);
+			}
+		}
+
+		seg_t *seg = sub->firstline;
+		for (DWORD j = 0; j < sub->numlines; ++j, ++seg)
+		{
+			if (seg->sidedef != NULL)
+			{
+				crc = HashSide (crc, seg->sidedef);
+			}
+			if (seg->backsector != NULL)
+			{
+				crc = HashSector (crc, seg->backsector);
+			}
+		}
+
+		for (FPolyNode *pn = sub->polys; pn != NULL; pn = pn->snext)
+		{
+			FPolyObj *poly = pn->poly;
+
+			crc = HashOf (crc, poly->Angle);
+			if (poly->Vertices.Size() > 0)
+			{
+				crc = HashOf (crc, poly->Vertices[0]->fPos());
+			}
+			for (unsigned k = 0; k < poly->Sidedefs.Size(); ++k)
+			{
+				crc = HashSide (crc, poly->Sidedefs[k]);
+			}
+		}
+
+		if (sec->validcount != validcount)
+		{
+			sec->validcount = validcount;
+			for (AActor *thing = sec->thinglist; thing != NULL; thing = thing->snext)
+			{
+				crc = HashThing (crc, thing);
+			}
+		}
+
+		for (WORD p = ParticlesInSubsec[(unsigned int)(sub - subsectors)]; p != NO_PARTICLE; p = Particles[p].snext)
+		{
+			crc = HashOf (crc, Particles[p].Pos);
+			crc = HashOf (crc, Particles[p].color);
+			crc = HashOf (crc, Particles[p].trans);
+			crc = HashOf (crc, Particles[p].size);
+		}
+	}
+	return crc;
+}
+
+//==========================================================================
+//
+// R_CheckSkyboxCache
+//
+// Decides what the skybox's visplanes do with the cache this frame. Only
+// the first of them compares and hashes anything.
+//
+//==========================================================================
+
+static ESkyboxCacheState R_CheckSkyboxCache (FSkyboxCache *cache)
+{
+	if (cache->CheckedFrame == SkyboxFrame)
+	{
+		return cache->State;
+	}
+	cache->CheckedFrame = SkyboxFrame;
+
+	FSkyboxView view;
+
+	R_GetSkyboxView (view);
+	if (memcmp (&view, &cache->View, sizeof(view)) != 0)
+	{
+		cache->View = view;
+		cache->Stable = 0;
+	}
+	else if (cache->Stable < SKYBOX_WAIT_FRAMES)
+	{
+		cache->Stable++;
+	}
+
+	if (cache->Stable < SKYBOX_WAIT_FRAMES)
+	{
+		cache->Subsectors.Clear ();
+		cache->Valid = false;
+		cache->State = SKYCACHE_Skip;
+	}
+	else if (cache->Subsectors.Size() == 0)
+	{
+		cache->State = SKYCACHE_Record;
+	}
+	else if (R_HashSkyboxContents (cache->Subsectors) != cache->Signature)
+	{
+		cache->Subsectors.Clear ();
+		cache->Valid = false;
+		cache->Stable = 0;
+		cache->State = SKYCACHE_Skip;
+	}
+	else
+	{
+		cache->State = SKYCACHE_Use;
+	}
+	return cache->State;
+}
+
+//==========================================================================
+//
+// R_CopySkyboxCache
+//
+// Copies the parts of the cached view that are covered by the visplane.
+//
+//==========================================================================
+
+static void R_CopySkyboxCache (const FSkyboxCache *cache, const visplane_t *pl)
+{
+	const BYTE *pixels = &cache->Pixels[0];
+
+	for (int x = pl->left; x < pl->right; ++x)
+	{
+		int top = pl->top[x];
+		if (top == 0x7fff)
+		{
+			continue;
+		}
+		const BYTE *src = pixels + ylookup[top] + x;
+		BYTE *dest = dc_destorg + ylookup[top] + x;
+		for (int y = top; y < pl->bottom[x]; ++y, src += dc_pitch, dest += dc_pitch)
+		{
+			*dest = *src;
+		}
+	}
+}
+
+//==========================================================================
+//
+// R_RenderSkybox
+//
+// Draws the walls and planes seen through one skybox visplane, or all of
+// the view if fullview is true. The view must already be set up.
+//
+//==========================================================================
+
+static void R_RenderSkybox (visplane_t *pl, bool fullview)
+{
+	int i;
+	int left = fullview ? 0 : pl->left;
+	int right = fullview ? viewwidth : pl->right;
+
+	R_ClearPlanes (false);
+	R_ClearClipSegs (left, right);
+	WindowLeft = left;
+	WindowRight = right;
+
+	for (i = left; i < right; i++)
+	{
+		if (fullview)
+		{
+			ceilingclip[i] = 0;
+			floorclip[i] = viewheight;
+		}
+		else if (pl->top[i] == 0x7fff)
+		{
+			ceilingclip[i] = viewheight;
+			floorclip[i] = -1;
+		}
+		else
+		{
+			ceilingclip[i] = pl->top[i];
+			floorclip[i] = pl->bottom[i];
+		}
+	}
+
+	// Create a drawseg to clip sprites to the sky plane
+	R_CheckDrawSegs ();
+	ds_p->CurrentPortalUniq = CurrentPortalUniq;
+	ds_p->siz1 = INT_MAX;
+	ds_p->siz2 = INT_MAX;
+	ds_p->sz1 = 0;
+	ds_p->sz2 = 0;
+	ds_p->x1 = left;
+	ds_p->x2 = right;
+	ds_p->silhouette = SIL_BOTH;
+	ds_p->sprbottomclip = R_NewOpening (right - left);
+	ds_p->sprtopclip = R_NewOpening (right - left);
+	ds_p->maskedtexturecol = ds_p->swall = -1;
+	ds_p->bFogBoundary = false;
+	ds_p->curline = NULL;
+	ds_p->fake = 0;
+	memcpy (openings + ds_p->sprbottomclip, floorclip + left, (right - left)*sizeof(short));
+	memcpy (openings + ds_p->sprtopclip, ceilingclip + left, (right - left)*sizeof(short));
+
+	firstvissprite = vissprite_p;
+	firstdrawseg = ds_p++;
+	FirstInterestingDrawseg = InterestingDrawsegs.Size();
+
+	InSubsector = NULL;
+	R_RenderBSPNode (nodes + numnodes - 1);
+	R_3D_ResetClip(); // reset clips (floor/ceiling)
+	R_DrawPlanes ();
+}
+
+//==========================================================================
+//
+// R_DiscardSkybox
+//
+// Throws away everything R_RenderSkybox added apart from what it drew.
+//
+//==========================================================================
+
+static void R_DiscardSkybox (visplane_t *pending, unsigned int numportals, ptrdiff_t opening)
+{
+	while (visplanes[MAXVISPLANES] != pending)
+	{
+		visplane_t *pl = visplanes[MAXVISPLANES];
+		visplanes[MAXVISPLANES] = pl->next;
+		pl->next = NULL;
+		*freehead = pl;
+		freehead = &pl->next;
+	}
+	WallPortals.Resize (numportals);
+	InterestingDrawsegs.Resize ((unsigned int)FirstInterestingDrawseg);
+	ds_p = firstdrawseg;
+	vissprite_p = firstvissprite;
+	lastopening = opening;
+}
+
 //==========================================================================
 //
 // R_DrawSkyBoxes
@@ -1175,9 +1972,14 @@ void R_DrawSinglePlane (visplane_t *pl, fixed_t alpha, bool additive, bool maske
 //   8. Repeat for any other sky boxes.
 //   9. Put the camera back where it was to begin with.
 //
+// Skyboxes that can use the cache skip steps 2 to 7 and copy it instead.
+// When the cache is redrawn, the window in step 3 is the whole view and
+// everything is drawn into the cache before it gets copied.
+//
 //==========================================================================
 CVAR (Bool, r_skyboxes, true, 0)
 static int numskyboxes;
+static int numcachedskyboxes;
 
 void R_DrawSkyBoxes ()
 {
@@ -1186,14 +1988,17 @@ void R_DrawSkyBoxes ()
 	static TArray<ptrdiff_t> visspriteStack;
 	static TArray<fixed_t> viewxStack, viewyStack, viewzStack;
 	static TArray<visplane_t *> visplaneStack;
+	static TArray<FSkyboxCache *> cacheStack;
 
 	numskyboxes = 0;
+	numcachedskyboxes = 0;
 
 	if (visplanes[MAXVISPLANES] == NULL)
 		return;
 
 	R_3D_EnterSkybox();
 	CurrentPortalInSkybox = true;
+	SkyboxFrame++;
 
 	int savedextralight = extralight;
 	fixed_t savedx = viewx;
@@ -1207,8 +2012,8 @@ void R_DrawSkyBoxes ()
 	float savedvisibility = R_GetVisibility ();
 	AActor *savedcamera = camera;
 	sector_t *savedsector = viewsector;
+	BYTE *saveddestorg = dc_destorg;
 
-	int i;
 	visplane_t *pl;
 
 	for (pl = visplanes[MAXVISPLANES]; pl != NULL; pl = visplanes[MAXVISPLANES])
@@ -1257,54 +2062,88 @@ void R_DrawSkyBoxes ()
 		}
 		ViewAngle = AngleToFloat(viewangle);
 
-		sky->bInSkybox = true;
-		if (mate != NULL) mate->bInSkybox = true;
 		camera = sky;
 		viewsector = sky->Sector;
 		R_SetViewAngle ();
 		validcount++;	// Make sure we see all sprites
 
-		R_ClearPlanes (false);
-		R_ClearClipSegs (pl->left, pl->right);
-		WindowLeft = pl->left;
-		WindowRight = pl->right;
+		// Stacked sectors move with the player, so only real skyboxes
+		// can be cached. The cached pixels are palette indices, so BGRA
+		// canvases never use the cache.
+		FSkyboxCache *cache = NULL;
+		bool fullview = false;
 
-		for (i = pl->left; i < pl->right; i++)
+		if (mate == NULL && r_skyboxcache && !fakeActive && !r_drawbgra)
+		{
+			cache = R_FindSkyboxCache (sky);
+		}
+		ESkyboxCacheState state = cache != NULL ? R_CheckSkyboxCache (cache) : SKYCACHE_Skip;
+		if (state == SKYCACHE_Skip)
 		{
-			if (pl->top[i] == 0x7fff)
+			cache = NULL;
+		}
+		if (cache != NULL)
+		{
+			if (state == SKYCACHE_Use && cache->Valid)
 			{
-				ceilingclip[i] = viewheight;
-				floorclip[i] = -1;
+				numcachedskyboxes++;
+				interestingStack.Push (InterestingDrawsegs.Size());
+				drawsegStack.Push (ds_p - drawsegs);
+				visspriteStack.Push (vissprite_p - vissprites);
+				viewxStack.Push (viewx);
+				viewyStack.Push (viewy);
+				viewzStack.Push (viewz);
+				visplaneStack.Push (pl);
+				cacheStack.Push (cache);
+				continue;
 			}
-			else
-			{
-				ceilingclip[i] = pl->top[i];
-				floorclip[i] = pl->bottom[i];
+			else if (state == SKYCACHE_Use)
+			{ // Nothing changed since the last frame, so it is worth drawing the whole view.
+				fullview = !cache->Portals;
+			}
+			SkyboxSubsectors.Clear ();
+			SubsectorLog = &SkyboxSubsectors;
+		}
+
+		sky->bInSkybox = true;
+		if (mate != NULL) mate->bInSkybox = true;
+
+		visplane_t *pending = visplanes[MAXVISPLANES];
+		unsigned int numportals = WallPortals.Size();
+		ptrdiff_t startopening = lastopening;
+
+		if (fullview)
+		{
+			cache->Pixels.Resize (dc_pitch * viewheight);
+			dc_destorg = &cache->Pixels[0];
+			R_RenderSkybox (pl, true);
+			dc_destorg = saveddestorg;
+
+			if (visplanes[MAXVISPLANES] != pending || WallPortals.Size() != numportals)
+			{ // Portals inside the skybox were clipped to the whole view, so
+			  // they cannot be drawn from here. Start over the normal way.
+				R_DiscardSkybox (pending, numportals, startopening);
+				SkyboxSubsectors.Clear ();
+				validcount++;
+				fullview = false;
 			}
 		}
+		if (!fullview)
+		{
+			R_RenderSkybox (pl, false);
+		}
 
-		// Create a drawseg to clip sprites to the sky plane
-		R_CheckDrawSegs ();
-		ds_p->CurrentPortalUniq = CurrentPortalUniq;
-		ds_p->siz1 = INT_MAX;
-		ds_p->siz2 = INT_MAX;
-		ds_p->sz1 = 0;
-		ds_p->sz2 = 0;
-		ds_p->x1 = pl->left;
-		ds_p->x2 = pl->right;
-		ds_p->silhouette = SIL_BOTH;
-		ds_p->sprbottomclip = R_NewOpening (pl->right - pl->left);
-		ds_p->sprtopclip = R_NewOpening (pl->right - pl->left);
-		ds_p->maskedtexturecol = ds_p->swall = -1;
-		ds_p->bFogBoundary = false;
-		ds_p->curline = NULL;
-		ds_p->fake = 0;
-		memcpy (openings + ds_p->sprbottomclip, floorclip + pl->left, (pl->right - pl->left)*sizeof(short));
-		memcpy (openings + ds_p->sprtopclip, ceilingclip + pl->left, (pl->right - pl->left)*sizeof(short));
-
-		firstvissprite = vissprite_p;
-		firstdrawseg = ds_p++;
-		FirstInterestingDrawseg = InterestingDrawsegs.Size();
+		if (cache != NULL)
+		{
+			SubsectorLog = NULL;
+			if (visplanes[MAXVISPLANES] != pending || WallPortals.Size() != numportals)
+			{
+				cache->Portals = true;
+			}
+			cache->Subsectors = SkyboxSubsectors;
+			cache->Signature = R_HashSkyboxContents (cache->Subsectors);
+			cache->Valid = cache->Fresh = fullview;
+		}
 
 		interestingStack.Push (FirstInterestingDrawseg);
 		ptrdiff_t diffnum = firstdrawseg - drawsegs;
@@ -1315,11 +2154,7 @@ void R_DrawSkyBoxes ()
 		viewyStack.Push (viewy);
 		viewzStack.Push (viewz);
 		visplaneStack.Push (pl);
-
-		InSubsector = NULL;
-		R_RenderBSPNode (nodes + numnodes - 1);
-		R_3D_ResetClip(); // reset clips (floor/ceiling)
-		R_DrawPlanes ();
+		cacheStack.Push (fullview ? cache : NULL);
 
 		sky->bInSkybox = false;
 		if (mate != NULL) mate->bInSkybox = false;
@@ -1331,6 +2166,7 @@ void R_DrawSkyBoxes ()
 	while (interestingStack.Pop (FirstInterestingDrawseg))
 	{
 		ptrdiff_t pd = 0;
+		FSkyboxCache *cache;
 
 		drawsegStack.Pop (pd);
 		firstdrawseg = drawsegs + pd;
@@ -1339,13 +2175,28 @@ void R_DrawSkyBoxes ()
 		viewxStack.Pop (viewx);	// Masked textures and planes need the view
 		viewyStack.Pop (viewy); // coordinates restored for proper positioning.
 		viewzStack.Pop (viewz);
+		visplaneStack.Pop (pl);
+		cacheStack.Pop (cache);
 
-		R_DrawMasked ();
+		if (cache == NULL)
+		{
+			R_DrawMasked ();
+		}
+		else
+		{
+			if (cache->Fresh)
+			{
+				dc_destorg = &cache->Pixels[0];
+				R_DrawMasked ();
+				dc_destorg = saveddestorg;
+				cache->Fresh = false;
+			}
+			R_CopySkyboxCache (cache, pl);
+		}
 
 		ds_p = firstdrawseg;
 		vissprite_p = firstvissprite;
 
-		visplaneStack.Pop (pl);
 		if (pl->Alpha > 0)
 		{
 			R_DrawSinglePlane (pl, pl->Alpha, pl->Additive, true);
@@ -1385,7 +2236,7 @@ void R_DrawSkyBoxes ()
 ADD_STAT(skyboxes)
 {
 	FString out;
-	out.Format ("%d skybox planes", numskyboxes);
+	out.Format ("%d skybox planes, %d from cache", numskyboxes, numcachedskyboxes);
 	return out;
 }
 
@@ -1589,12 +2440,16 @@ void R_DrawNormalPlane (visplane_t *pl, fixed_t alpha, bool additive, bool maske
 					spanfunc = R_DrawSpanMaskedTranslucent;
 					dc_srcblend = Col2RGB8[alpha>>10];
 					dc_destblend = Col2RGB8[(OPAQUE-alpha)>>10];
+					dc_srcalpha = alpha;
+					dc_destalpha = OPAQUE-alpha;
 				}
 				else
 				{
 					spanfunc = R_DrawSpanMaskedAddClamp;
 					dc_srcblend = Col2RGB8_LessPrecision[alpha>>10];
 					dc_destblend = Col2RGB8_LessPrecision[FRACUNIT>>10];
+					dc_srcalpha = alpha;
+					dc_destalpha = FRACUNIT;
 				}
 			}
 			else
@@ -1611,12 +2466,16 @@ void R_DrawNormalPlane (visplane_t *pl, fixed_t alpha, bool additive, bool maske
 					spanfunc = R_DrawSpanTranslucent;
 					dc_srcblend = Col2RGB8[alpha>>10];
 					dc_destblend = Col2RGB8[(OPAQUE-alpha)>>10];
+					dc_srcalpha = alpha;
+					dc_destalpha = OPAQUE-alpha;
 				}
 				else
 				{
 					spanfunc = R_DrawSpanAddClamp;
 					dc_srcblend = Col2RGB8_LessPrecision[alpha>>10];
 					dc_destblend = Col2RGB8_LessPrecision[FRACUNIT>>10];
+					dc_srcalpha = alpha;
+					dc_destalpha = FRACUNIT;
 				}
 			}
 			else
@@ -1743,6 +2602,11 @@ void R_DrawTiltedPlane (visplane_t *pl, fixed_t alpha, bool additive, bool maske
 	}
 
 #if defined(X86_ASM)
+	if (r_tilterror > 0)
+	{
+		R_MapVisPlane (pl, R_MapTiltedPlane);
+		return;
+	}
 	if (ds_source != ds_curtiltedsource)
 		R_SetTiltedSpanSource_ASM (ds_source);
 	R_MapVisPlane (pl, R_DrawTiltedPlane_ASM);
@@ -1823,32 +2687,9 @@ void R_MapVisPlane (visplane_t *pl, void (*mapfunc)(int y, int x1))
 
 bool R_PlaneInitData ()
 {
-	int i;
-	visplane_t *pl;
-
-	// Free all visplanes and let them be re-allocated as needed.
-	pl = freetail;
-
-	while (pl)
-	{
-		visplane_t *next = pl->next;
-		M_Free (pl);
-		pl = next;
-	}
-	freetail = NULL;
-	freehead = &freetail;
-
-	for (i = 0; i < MAXVISPLANES; i++)
-	{
-		pl = visplanes[i];
-		visplanes[i] = NULL;
-		while (pl)
-		{
-			visplane_t *next = pl->next;
-			M_Free (pl);
-			pl = next;
-		}
-	}
-
+	// Free all visplanes and let them be re-allocated as needed, sized for
+	// the new resolution.
+	R_FreeVisplanes ();
+	VisplaneWidth = 0;
 	return true;
 }
@@ -88,7 +88,9 @@ void R_DeinitPlanes ();
 void R_ClearPlanes (bool fullclear);
 
 int R_DrawPlanes ();
+void R_FlushSpanQueue ();
 void R_DrawSkyBoxes ();
+void R_ClearSkyboxCache ();
 void R_DrawSkyPlane (visplane_t *pl);
 void R_DrawNormalPlane (visplane_t *pl, fixed_t alpha, bool additive, bool masked);
 void R_DrawTiltedPlane (visplane_t *pl, fixed_t alpha, bool additive, bool masked);
@@ -0,0 +1,142 @@
+/*
+** r_profile.cpp
+** Per-frame stage profiler
+**
+** The fps stats only show the last frame, which is useless for finding
+** the occasional long frame. This keeps the stage times of the last
+** PROFILE_FRAMES frames so that percentiles can be computed from them.
+**
+*/
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "templates.h"
+#include "doomtype.h"
+#include "c_dispatch.h"
+#include "c_cvars.h"
+#include "r_profile.h"
+
+#define PROFILE_FRAMES		4096
+#define HISTOGRAM_BUCKETS	34		// 0.5 ms each, the last one is everything above 16.5 ms
+#define HISTOGRAM_STEP		0.5
+
+static double ProfileTimes[PROFILE_FRAMES][NUM_PROF_STAGES];
+static int ProfileHead;
+static int ProfileCount;
+
+static const char *const StageNames[NUM_PROF_STAGES] =
+{
+	"frame", "bsp", "planes", "skyboxes", "masked", "2d", "blit"
+};
+
+CUSTOM_CVAR (Bool, r_profile, false, 0)
+{
+	ProfileHead = ProfileCount = 0;
+}
+
+bool R_IsProfiling ()
+{
+	return r_profile;
+}
+
+//==========================================================================
+//
+// R_ProfileFrame
+//
+//==========================================================================
+
+void R_ProfileFrame (const double times[NUM_PROF_STAGES])
+{
+	memcpy (ProfileTimes[ProfileHead], times, sizeof(ProfileTimes[0]));
+	ProfileHead = (ProfileHead + 1) % PROFILE_FRAMES;
+	if (ProfileCount < PROFILE_FRAMES)
+	{
+		ProfileCount++;
+	}
+}
+
+//==========================================================================
+//
+// CCMD dumpprofile
+//
+// Writes a summary line and a histogram for every stage over the frames
+// currently in the ring buffer.
+//
+//==========================================================================
+
+CCMD (dumpprofile)
+{
+	if (argv.argc() < 2)
+	{
+		Printf ("Usage: dumpprofile <file>\n");
+		return;
+	}
+	if (ProfileCount == 0)
+	{
+		Printf ("No frames recorded. Set r_profile to true first.\n");
+		return;
+	}
+
+	FILE *f = fopen (argv[1], "w");
+	if (f == NULL)
+	{
+		Printf ("Could not open %s for writing\n", argv[1]);
+		return;
+	}
+
+	TArray<double> sorted(ProfileCount);
+	sorted.Resize (ProfileCount);
+
+	fprintf (f, "stage,frames,min_ms,avg_ms,p50_ms,p99_ms,max_ms\n");
+	int hist[NUM_PROF_STAGES][HISTOGRAM_BUCKETS] = { { 0 } };
+
+	for (int s = 0; s < NUM_PROF_STAGES; ++s)
+	{
+		double sum = 0;
+		for (int i = 0; i < ProfileCount; ++i)
+		{
+			double t = ProfileTimes[i][s];
+			sorted[i] = t;
+			sum += t;
+			hist[s][MIN<int> (int(t / HISTOGRAM_STEP), HISTOGRAM_BUCKETS - 1)]++;
+		}
+		std::sort (&sorted[0], &sorted[0] + ProfileCount);
+		fprintf (f, "%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f\n", StageNames[s], ProfileCount,
+			sorted[0], sum / ProfileCount, sorted[ProfileCount / 2],
+			sorted[MIN (ProfileCount - 1, ProfileCount * 99 / 100)], sorted[ProfileCount - 1]);
+		if (s == PROF_Frame)
+		{
+			Printf ("%d frames: avg %.2f ms, p99 %.2f ms, max %.2f ms\n", ProfileCount,
+				sum / ProfileCount, sorted[MIN (ProfileCount - 1, ProfileCount * 99 / 100)], sorted[ProfileCount - 1]);
+		}
+	}
+
+	fprintf (f, "\nbucket_ms");
+	for (int s = 0; s < NUM_PROF_STAGES; ++s)
+	{
+		fprintf (f, ",%s", StageNames[s]);
+	}
+	fprintf (f, "\n");
+	for (int b = 0; b < HISTOGRAM_BUCKETS; ++b)
+	{
+		fprintf (f, "%.1f", b * HISTOGRAM_STEP);
+		for (int s = 0; s < NUM_PROF_STAGES; ++s)
+		{
+			fprintf (f, ",%d", hist[s][b]);
+		}
+		fprintf (f, "\n");
+	}
+	fclose (f);
+}
+
+//==========================================================================
+//
+// CCMD clearprofile
+//
+//==========================================================================
+
+CCMD (clearprofile)
+{
+	ProfileHead = ProfileCount = 0;
+}
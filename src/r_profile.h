@@ -0,0 +1,30 @@
+#ifndef __R_PROFILE_H
+#define __R_PROFILE_H
+
+//
+// Per-frame stage profiler.
+//
+// While r_profile is on, D_Display records the time every frame spent in
+// each stage into a ring buffer. "dumpprofile" writes min/avg/p99/max and
+// a histogram of each stage to a file.
+//
+
+enum EProfileStage
+{
+	PROF_Frame,
+	PROF_BSP,			// R_RenderBSPNode and the walls drawn by it
+	PROF_Planes,		// R_DrawPlanes
+	PROF_SkyBoxes,		// R_DrawSkyBoxes
+	PROF_Masked,		// R_DrawMasked
+	PROF_2D,			// HUD, status bar, console and menus
+	PROF_Blit,			// DFrameBuffer::Update
+
+	NUM_PROF_STAGES
+};
+
+// Adds the times of the frame that was just drawn to the ring buffer.
+void R_ProfileFrame (const double times[NUM_PROF_STAGES]);
+
+bool R_IsProfiling ();
+
+#endif
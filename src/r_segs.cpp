@@ -27,6 +27,7 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <float.h>
 
 #include "templates.h"
 #include "i_system.h"
@@ -52,6 +53,7 @@
 #include "r_3dfloors.h"
 #include "v_palette.h"
 #include "r_data/colormaps.h"
+#include "x86.h"
 
 #define WALLYREPEAT 8
 
@@ -134,7 +136,9 @@ FTexture		*rw_pic;
 
 static fixed_t	*maskedtexturecol;
 
-static void R_RenderDecal (side_t *wall, DBaseDecal *first, drawseg_t *clipper, int pass);
+struct FDecalWall;
+static void R_RenderDecals (side_t *wall, drawseg_t *clipper, int pass);
+static void R_RenderDecal (side_t *wall, DBaseDecal *first, drawseg_t *clipper, int pass, const FDecalWall &info);
 static void WallSpriteColumn (void (*drawfunc)(const BYTE *column, const FTexture::Span *spans));
 void wallscan_np2(int x1, int x2, short *uwal, short *dwal, fixed_t *swal, fixed_t *lwal, fixed_t yrepeat, fixed_t top, fixed_t bot, bool mask);
 static void wallscan_np2_ds(drawseg_t *ds, int x1, int x2, short *uwal, short *dwal, fixed_t *swal, fixed_t *lwal, fixed_t yrepeat);
@@ -2617,10 +2621,7 @@ void R_StoreWallRange (int start, int stop)
 	// [ZZ] Only if not an active mirror
 	if (!rw_markportal)
 	{
-		for (DBaseDecal *decal = curline->sidedef->AttachedDecals; decal != NULL; decal = decal->WallNext)
-		{
-			R_RenderDecal (curline->sidedef, decal, ds_p, 0);
-		}
+		R_RenderDecals (curline->sidedef, ds_p, 0);
 	}
 
 	if (rw_markportal)
@@ -2636,6 +2637,8 @@ void R_StoreWallRange (int start, int stop)
 		pds.floorclip.Resize(pds.len);
 		memcpy(&pds.floorclip[0], openings + ds_p->sprbottomclip, pds.len*sizeof(*openings));
 
+		pds.wx1 = pds.x2;
+		pds.wx2 = pds.x1;
 		for (int i = 0; i < pds.x2-pds.x1; i++)
 		{
 			if (pds.ceilingclip[i] < 0)
@@ -2646,6 +2649,14 @@ void R_StoreWallRange (int start, int stop)
 				pds.floorclip[i] = 0;
 			if (pds.floorclip[i] >= viewheight)
 				pds.floorclip[i] = viewheight-1;
+
+			// Track the columns that are still open for R_EnterPortal.
+			if (pds.ceilingclip[i] < pds.floorclip[i])
+			{
+				if (pds.wx1 == pds.x2)
+					pds.wx1 = pds.x1 + i;
+				pds.wx2 = pds.x1 + i + 1;
+			}
 		}
 
 		pds.mirror = curline->linedef->special == Line_Mirror;
@@ -2655,6 +2666,35 @@ void R_StoreWallRange (int start, int stop)
 	ds_p++;
 }
 
+//==========================================================================
+//
+// InterpolateMost
+//
+// Fills in the columns between the two ends of a wall top or bottom.
+//
+//==========================================================================
+
+TArray<FWallPrepCall> *WallPrepRecord;
+
+static void InterpolateMost (short *mostbuf, DWORD count, SDWORD val, SDWORD delta)
+{
+	if (WallPrepRecord != NULL)
+	{
+		FWallPrepCall call = { FWallPrepCall::Most, WallT, centerx, WallTMapScale2, 0, 0, int(count), val, delta };
+		WallPrepRecord->Push(call);
+	}
+#if defined(_M_X64) || defined(_M_IX86) || defined(__i386__) || defined(__amd64__)
+	if (CPU.bSSE2)
+	{
+		InterpolateMost_SSE2 (mostbuf, count, val, delta);
+	}
+	else
+#endif
+	{
+		qinterpolatedown16short (mostbuf, count, val, delta);
+	}
+}
+
 int OWallMost (short *mostbuf, fixed_t z, const FWallCoords *wallc)
 {
 	int bad, y, ix1, ix2, iy1, iy2;
@@ -2725,7 +2765,7 @@ int OWallMost (short *mostbuf, fixed_t z, const FWallCoords *wallc)
 	else
 	{
 		fixed_t yinc  = (Scale (z, InvZtoScale, iy2) - y) / (ix2 - ix1);
-		qinterpolatedown16short (&mostbuf[ix1], ix2-ix1, y + centeryfrac, yinc);
+		InterpolateMost (&mostbuf[ix1], ix2-ix1, y + centeryfrac, yinc);
 	}
 #else
 	double max = viewheight;
@@ -2909,7 +2949,7 @@ int WallMost (short *mostbuf, const secplane_t &plane, const FWallCoords *wallc)
 	else
 	{
 		fixed_t yinc = (Scale (z2>>4, InvZtoScale, iy2) - y) / (ix2-ix1);
-		qinterpolatedown16short (&mostbuf[ix1], ix2-ix1, y + centeryfrac,yinc);
+		InterpolateMost (&mostbuf[ix1], ix2-ix1, y + centeryfrac, yinc);
 	}
 
 	return bad;
@@ -2950,7 +2990,7 @@ static void PrepWallRoundFix(fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
 	}
 }
 
-void PrepWall (fixed_t *swall, fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
+void PrepWall_C (fixed_t *swall, fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
 { // swall = scale, lwall = texturecolumn
 	double top, bot, i;
 	double xrepeat = fabs((double)walxrepeat);
@@ -2976,10 +3016,29 @@ void PrepWall (fixed_t *swall, fixed_t *lwall, fixed_t walxrepeat, int x1, int x
 		top += WallT.UoverZstep;
 		bot += WallT.InvZstep;
 	}
+}
+
+void PrepWall (fixed_t *swall, fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
+{
+	if (WallPrepRecord != NULL)
+	{
+		FWallPrepCall call = { FWallPrepCall::Wall, WallT, centerx, WallTMapScale2, walxrepeat, x1, x2, 0, 0 };
+		WallPrepRecord->Push(call);
+	}
+#ifdef SSE2_WALLPREP
+	if (CPU.bSSE2)
+	{
+		PrepWall_SSE2 (swall, lwall, walxrepeat, x1, x2);
+	}
+	else
+#endif
+	{
+		PrepWall_C (swall, lwall, walxrepeat, x1, x2);
+	}
 	PrepWallRoundFix(lwall, walxrepeat, x1, x2);
 }
 
-void PrepLWall (fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
+void PrepLWall_C (fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
 { // lwall = texturecolumn
 	double top, bot, i;
 	double xrepeat = fabs((double)walxrepeat);
@@ -3005,14 +3064,150 @@ void PrepLWall (fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
 		top += topstep;
 		bot += WallT.InvZstep;
 	}
+}
+
+void PrepLWall (fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
+{
+	if (WallPrepRecord != NULL)
+	{
+		FWallPrepCall call = { FWallPrepCall::LWall, WallT, centerx, WallTMapScale2, walxrepeat, x1, x2, 0, 0 };
+		WallPrepRecord->Push(call);
+	}
+#ifdef SSE2_WALLPREP
+	if (CPU.bSSE2)
+	{
+		PrepLWall_SSE2 (lwall, walxrepeat, x1, x2);
+	}
+	else
+#endif
+	{
+		PrepLWall_C (lwall, walxrepeat, x1, x2);
+	}
 	PrepWallRoundFix(lwall, walxrepeat, x1, x2);
 }
 
+//==========================================================================
+//
+// Decals
+//
+// A wall can carry hundreds of decals, so everything that only depends on
+// the wall is worked out once in R_RenderDecals. That includes the part of
+// the wall the drawseg can show, expressed in the same units as
+// DBaseDecal::LeftDistance (0 at the side's first vertex, 1 at its
+// second), so decals outside of it can be skipped before they are
+// projected.
+//
+//==========================================================================
+
+struct FDecalWall
+{
+	angle_t Angle;			// Fine angle of curline
+	double Length;			// Length of the wall's line
+	double Left, Right;		// Visible part of the wall
+};
+
+//==========================================================================
+//
+// R_GetVisibleDecalRange
+//
+// Finds the part of the side seen through columns x1 to x2 of curline.
+// WallC must still hold curline's coordinates. The result is a little
+// too large rather than too small.
+//
+//==========================================================================
+
+static void R_GetVisibleDecalRange (side_t *wall, int x1, int x2, FDecalWall &info)
+{
+	line_t *line = wall->linedef;
+	vertex_t *sv1 = line->sidedef[0] == wall ? line->v1 : line->v2;
+	vertex_t *sv2 = line->sidedef[0] == wall ? line->v2 : line->v1;
+	double dx = sv2->fX() - sv1->fX();
+	double dy = sv2->fY() - sv1->fY();
+	double len2 = dx*dx + dy*dy;
+
+	info.Length = sqrt (len2);
+	info.Left = -DBL_MAX;
+	info.Right = DBL_MAX;
+	if (len2 == 0)
+	{
+		return;
+	}
+
+	// Where the seg's ends are on the side
+	double fa = ((curline->v1->fX() - sv1->fX()) * dx + (curline->v1->fY() - sv1->fY()) * dy) / len2;
+	double fb = ((curline->v2->fX() - sv1->fX()) * dx + (curline->v2->fY() - sv1->fY()) * dy) / len2;
+	double ta = 0, tb = 1;
+
+	// Mirrored view coordinates are not a simple function of the seg, so
+	// only the seg itself is used for those.
+	if (!(MirrorFlags & RF_XFLIP))
+	{
+		// Along the seg, the view space coordinates are linear, and the
+		// column a point shows up in is centerx * (1 + tx/ty). Solving
+		// that for two columns just outside the drawseg gives its ends.
+		double tx1 = WallC.tx1, ty1 = WallC.ty1;
+		double dtx = WallC.tx2 - tx1, dty = WallC.ty2 - ty1;
+		double t[2];
+		int edge[2] = { x1 - 2, x2 + 2 };
+		int i;
+
+		for (i = 0; i < 2; ++i)
+		{
+			double k = double(edge[i] - centerx) / centerx;
+			double den = dtx - k * dty;
+			if (den == 0)
+			{
+				break;
+			}
+			t[i] = clamp ((k * ty1 - tx1) / den, 0., 1.);
+			if (ty1 + t[i] * dty <= 0)
+			{
+				break;
+			}
+		}
+		if (i == 2)
+		{
+			ta = MIN (t[0], t[1]);
+			tb = MAX (t[0], t[1]);
+		}
+	}
+	double left = fa + ta * (fb - fa);
+	double right = fa + tb * (fb - fa);
+	info.Left = MIN (left, right);
+	info.Right = MAX (left, right);
+}
+
+//==========================================================================
+//
+// R_RenderDecals
+//
+// Draws all the decals on a wall that can be seen through clipper.
+//
+//==========================================================================
+
+static void R_RenderDecals (side_t *wall, drawseg_t *clipper, int pass)
+{
+	if (wall->AttachedDecals == NULL || !viewactive)
+	{
+		return;
+	}
+
+	FDecalWall info;
+
+	info.Angle = R_PointToAngle2 (curline->v1->fixX(), curline->v1->fixY(), curline->v2->fixX(), curline->v2->fixY()) >> ANGLETOFINESHIFT;
+	R_GetVisibleDecalRange (wall, clipper->x1, clipper->x2, info);
+
+	for (DBaseDecal *decal = wall->AttachedDecals; decal != NULL; decal = decal->WallNext)
+	{
+		R_RenderDecal (wall, decal, clipper, pass, info);
+	}
+}
+
 // pass = 0: when seg is first drawn
 //		= 1: drawing masked textures (including sprites)
 // Currently, only pass = 0 is done or used
 
-static void R_RenderDecal (side_t *wall, DBaseDecal *decal, drawseg_t *clipper, int pass)
+static void R_RenderDecal (side_t *wall, DBaseDecal *decal, drawseg_t *clipper, int pass, const FDecalWall &info)
 {
 	fixed_t lx, ly, lx2, ly2, decalx, decaly;
 	int x1, x2;
@@ -3080,6 +3275,17 @@ static void R_RenderDecal (side_t *wall, DBaseDecal *decal, drawseg_t *clipper,
 		return;
 	}
 
+	// Skip it if it is not on the visible part of the wall.
+	if (info.Length > 0)
+	{
+		double dleft = decal->LeftDistance - WallSpriteTile->LeftOffset * decal->ScaleX / info.Length;
+		double dright = decal->LeftDistance + (WallSpriteTile->GetWidth() - WallSpriteTile->LeftOffset) * decal->ScaleX / info.Length;
+		if (MAX (dleft, dright) < info.Left || MIN (dleft, dright) > info.Right)
+		{
+			return;
+		}
+	}
+
 	// Determine left and right edges of sprite. Since this sprite is bound
 	// to a wall, we use the wall's angle instead of the decal's. This is
 	// pretty much the same as what R_AddLine() does.
@@ -3098,7 +3304,7 @@ static void R_RenderDecal (side_t *wall, DBaseDecal *decal, drawseg_t *clipper,
 	decalx = FLOAT2FIXED(dcx);
 	decaly = FLOAT2FIXED(dcy);
 
-	angle_t ang = R_PointToAngle2 (curline->v1->fixX(), curline->v1->fixY(), curline->v2->fixX(), curline->v2->fixY()) >> ANGLETOFINESHIFT;
+	angle_t ang = info.Angle;
 	lx  = decalx - FixedMul (x1, finecosine[ang]) - viewx;
 	lx2 = decalx + FixedMul (x2, finecosine[ang]) - viewx;
 	ly  = decaly - FixedMul (x1, finesine[ang]) - viewy;
@@ -36,6 +36,34 @@ int WallMost (short *mostbuf, const secplane_t &plane, const FWallCoords *wallc)
 void PrepWall (fixed_t *swall, fixed_t *lwall, fixed_t walxrepeat, int x1, int x2);
 void PrepLWall (fixed_t *lwall, fixed_t walxrepeat, int x1, int x2);
 
+// The SSE2 wall setup only gives the same results as the C version when
+// that does its double math with SSE2 too. 32-bit builds that use the x87
+// round differently, so they always use the C version.
+#if defined(_M_X64) || defined(__amd64__) || defined(__SSE2_MATH__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SSE2_WALLPREP
+#endif
+
+// The C and SSE2 versions behind PrepWall, PrepLWall and the column filling
+// of (O)WallMost. These are only public for "benchwallprep".
+void PrepWall_C (fixed_t *swall, fixed_t *lwall, fixed_t walxrepeat, int x1, int x2);
+void PrepLWall_C (fixed_t *lwall, fixed_t walxrepeat, int x1, int x2);
+void PrepWall_SSE2 (fixed_t *swall, fixed_t *lwall, fixed_t walxrepeat, int x1, int x2);
+void PrepLWall_SSE2 (fixed_t *lwall, fixed_t walxrepeat, int x1, int x2);
+void InterpolateMost_SSE2 (short *out, DWORD count, SDWORD val, SDWORD delta);
+
+// When set, the arguments of every call to the above are added to it.
+struct FWallPrepCall
+{
+	enum { Wall, LWall, Most } Type;
+	FWallTmapVals WallT;
+	int CenterX;
+	float TMapScale2;
+	fixed_t WalXRepeat;
+	int x1, x2;				// For Most, x2 is the count
+	SDWORD Val, Delta;
+};
+extern TArray<FWallPrepCall> *WallPrepRecord;
+
 ptrdiff_t R_NewOpening (ptrdiff_t len);
 
 void R_CheckDrawSegs ();
@@ -57,6 +85,8 @@ struct PortalDrawseg
 
 	int x1; // drawseg x1
 	int x2; // drawseg x2
+	int wx1; // first column that can be seen through
+	int wx2; // one past the last such column; wx1 >= wx2 if the portal is covered
 
 	int len;
 	TArray<short> ceilingclip;
@@ -0,0 +1,184 @@
+/*
+** r_segs_sse2.cpp
+** SSE2 versions of the per-column wall setup in r_segs.cpp
+**
+** The texture position and scale of each column is a division of two
+** running sums. The sums are still stepped one column at a time, because
+** adding the step twice does not round the same as adding it doubled, but
+** the divisions and the conversions to fixed point are done two columns
+** at once. The conversions use the same magic number trick as
+** xs_RoundToInt, so the results are bit-for-bit identical to the C
+** versions as long as those do their double math in SSE2 registers too.
+** "benchwallprep" checks this on the walls of the current view.
+**
+*/
+
+#include <math.h>
+
+#include "templates.h"
+#include "doomtype.h"
+#include "doomdef.h"
+#include "r_local.h"
+#include "r_segs.h"
+#include "xs_Float.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__i386__) || defined(__amd64__)
+
+#include <emmintrin.h>
+
+//==========================================================================
+//
+// RoundToInt
+//
+// xs_RoundToInt for two doubles. The integers end up in the low half.
+//
+//==========================================================================
+
+static inline __m128i RoundToInt (__m128d val)
+{
+	val = _mm_add_pd(val, _mm_set1_pd(_xs_doublemagicdelta));
+	val = _mm_add_pd(val, _mm_set1_pd(_xs_doublemagic));
+	return _mm_shuffle_epi32(_mm_castpd_si128(val), _MM_SHUFFLE(3,3,2,0));
+}
+
+//==========================================================================
+//
+// PrepWall_SSE2
+//
+//==========================================================================
+
+void PrepWall_SSE2 (fixed_t *swall, fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
+{
+	double top, bot, i;
+	double xrepeat = fabs((double)walxrepeat);
+	double depth_scale = WallT.InvZstep * WallTMapScale2;
+	double depth_org = -WallT.UoverZstep * WallTMapScale2;
+	double topstep = WallT.UoverZstep;
+	double botstep = WallT.InvZstep;
+	__m128d rep = _mm_set1_pd(xrepeat);
+	__m128d dscale = _mm_set1_pd(depth_scale);
+	__m128d dorg = _mm_set1_pd(depth_org);
+	int x;
+
+	i = x1 - centerx;
+	top = WallT.UoverZorg + WallT.UoverZstep * i;
+	bot = WallT.InvZorg + WallT.InvZstep * i;
+
+	for (x = x1; x + 2 <= x2; x += 2)
+	{
+		double top1 = top + topstep;
+		double bot1 = bot + botstep;
+		__m128d frac = _mm_div_pd(_mm_setr_pd(top, top1), _mm_setr_pd(bot, bot1));
+		__m128d tex = _mm_mul_pd(frac, rep);
+
+		if (walxrepeat < 0)
+		{
+			tex = _mm_sub_pd(rep, tex);
+		}
+		_mm_storel_epi64((__m128i *)&lwall[x], RoundToInt(tex));
+		_mm_storel_epi64((__m128i *)&swall[x], RoundToInt(_mm_add_pd(_mm_mul_pd(frac, dscale), dorg)));
+		top = top1 + topstep;
+		bot = bot1 + botstep;
+	}
+	if (x < x2)
+	{
+		double frac = top / bot;
+		if (walxrepeat < 0)
+		{
+			lwall[x] = xs_RoundToInt(xrepeat - frac * xrepeat);
+		}
+		else
+		{
+			lwall[x] = xs_RoundToInt(frac * xrepeat);
+		}
+		swall[x] = xs_RoundToInt(frac * depth_scale + depth_org);
+	}
+}
+
+//==========================================================================
+//
+// PrepLWall_SSE2
+//
+//==========================================================================
+
+void PrepLWall_SSE2 (fixed_t *lwall, fixed_t walxrepeat, int x1, int x2)
+{
+	double top, bot, i;
+	double xrepeat = fabs((double)walxrepeat);
+	double topstep;
+	double botstep = WallT.InvZstep;
+	__m128d rep = _mm_set1_pd(xrepeat);
+	int x;
+
+	i = x1 - centerx;
+	top = WallT.UoverZorg + WallT.UoverZstep * i;
+	bot = WallT.InvZorg + WallT.InvZstep * i;
+
+	top *= xrepeat;
+	topstep = WallT.UoverZstep * xrepeat;
+
+	for (x = x1; x + 2 <= x2; x += 2)
+	{
+		double top1 = top + topstep;
+		double bot1 = bot + botstep;
+		__m128d tex = _mm_div_pd(_mm_setr_pd(top, top1), _mm_setr_pd(bot, bot1));
+
+		if (walxrepeat < 0)
+		{
+			tex = _mm_sub_pd(rep, tex);
+		}
+		_mm_storel_epi64((__m128i *)&lwall[x], RoundToInt(tex));
+		top = top1 + topstep;
+		bot = bot1 + botstep;
+	}
+	if (x < x2)
+	{
+		if (walxrepeat < 0)
+		{
+			lwall[x] = xs_RoundToInt(xrepeat - top / bot);
+		}
+		else
+		{
+			lwall[x] = xs_RoundToInt(top / bot);
+		}
+	}
+}
+
+//==========================================================================
+//
+// InterpolateMost_SSE2
+//
+// qinterpolatedown16short eight columns at a time. Integer addition wraps
+// the same way no matter how it is grouped, so this is exact.
+//
+//==========================================================================
+
+void InterpolateMost_SSE2 (short *out, DWORD count, SDWORD val, SDWORD delta)
+{
+	if (count >= 8)
+	{
+		DWORD v = (DWORD)val, d = (DWORD)delta;
+		__m128i lo = _mm_setr_epi32(v, v + d, v + d*2, v + d*3);
+		__m128i hi = _mm_add_epi32(lo, _mm_set1_epi32(d*4));
+		__m128i step = _mm_set1_epi32(d*8);
+		DWORD done = count & ~7;
+
+		for (; count >= 8; count -= 8)
+		{
+			// The high words of 32-bit values always fit in a short, so
+			// the saturation of the pack never kicks in.
+			_mm_storeu_si128((__m128i *)out, _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16)));
+			out += 8;
+			lo = _mm_add_epi32(lo, step);
+			hi = _mm_add_epi32(hi, step);
+		}
+		val = (SDWORD)(v + d * done);
+	}
+	for (; count > 0; --count)
+	{
+		*out++ = (short)(val >> 16);
+		val = (SDWORD)((DWORD)val + (DWORD)delta);
+	}
+}
+
+#endif
@@ -38,10 +38,12 @@
 #include "v_video.h"
 #include "m_png.h"
 #include "r_bsp.h"
+#include "r_plane.h"
 #include "r_swrenderer.h"
 #include "r_3dfloors.h"
 #include "textures/textures.h"
 #include "r_data/voxels.h"
+#include "stats.h"
 
 
 class FArchive;
@@ -52,6 +54,19 @@ void R_InitRenderer();
 
 extern float LastFOV;
 
+//==========================================================================
+//
+// FSoftwareRenderer :: ~FSoftwareRenderer
+//
+//==========================================================================
+
+static void R_FreeDynamicCanvas ();
+
+FSoftwareRenderer::~FSoftwareRenderer()
+{
+	R_FreeDynamicCanvas ();
+}
+
 //==========================================================================
 //
 // DCanvas :: Init
@@ -100,6 +115,117 @@ void FSoftwareRenderer::PrecacheTexture(FTexture *tex, int cache)
 	}
 }
 
+//===========================================================================
+//
+// Dynamic resolution
+//
+// When r_dynres_target is set, the 3D view is drawn at a lower resolution
+// whenever drawing the last one took longer than that many milliseconds and
+// stretched back up to the full view size. The scale drops right away when
+// a frame is too slow and creeps back up once frames are fast again, so
+// short spikes are absorbed without making the picture pump.
+//
+//===========================================================================
+
+extern cycle_t WallCycles, PlaneCycles, MaskedCycles;
+
+CVAR (Float, r_dynres_target, 0.f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+CUSTOM_CVAR (Float, r_dynres_minscale, 0.5f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0.25f)
+	{
+		self = 0.25f;
+	}
+	else if (self > 1.f)
+	{
+		self = 1.f;
+	}
+}
+
+static double DynamicScale = 1;
+static double DynamicViewTime;		// Milliseconds the last player view took to draw
+static DSimpleCanvas *DynamicCanvas;
+
+static double R_GetDynamicScale ()
+{
+	if (r_dynres_target <= 0)
+	{
+		DynamicScale = 1;
+		return 1;
+	}
+
+	if (DynamicViewTime > 0)
+	{
+		// Drawing time is roughly proportional to the number of pixels.
+		double want = clamp (DynamicScale * sqrt(r_dynres_target / DynamicViewTime), (double)r_dynres_minscale, 1.);
+		if (want < DynamicScale)
+		{
+			DynamicScale = want;
+		}
+		else
+		{
+			DynamicScale += (want - DynamicScale) * 0.05;
+		}
+	}
+	// Snap to 1/32 steps so that the view size does not change every frame.
+	return MIN (1., floor(DynamicScale * 32 + 0.5) / 32);
+}
+
+static void R_FreeDynamicCanvas ()
+{
+	if (DynamicCanvas != NULL)
+	{
+		DynamicCanvas->Destroy ();
+		DynamicCanvas->ObjectFlags |= OF_YesReallyDelete;
+		delete DynamicCanvas;
+		DynamicCanvas = NULL;
+	}
+}
+
+static void R_RenderDynamicView (AActor *actor, double scale)
+{
+	static int xmap[MAXWIDTH];
+
+	if (DynamicCanvas == NULL || DynamicCanvas->GetWidth() != SCREENWIDTH || DynamicCanvas->GetHeight() != SCREENHEIGHT)
+	{
+		R_FreeDynamicCanvas ();
+		DynamicCanvas = new DSimpleCanvas (SCREENWIDTH, SCREENHEIGHT);
+		DynamicCanvas->ObjectFlags |= OF_Fixed;
+	}
+
+	int width, height;
+	DynamicCanvas->Lock ();
+	R_RenderViewToCanvasScaled (actor, DynamicCanvas, scale, width, height);
+
+	// Nearest neighbor stretch into the real view window.
+	const BYTE *src = DynamicCanvas->GetBuffer ();
+	int srcpitch = DynamicCanvas->GetPitch ();
+	BYTE *dest = screen->GetBuffer () + viewwindowy * screen->GetPitch () + viewwindowx;
+	int destpitch = screen->GetPitch ();
+	int lastsy = -1;
+
+	for (int x = 0; x < viewwidth; ++x)
+	{
+		xmap[x] = x * width / viewwidth;
+	}
+	for (int y = 0; y < viewheight; ++y, dest += destpitch)
+	{
+		int sy = y * height / viewheight;
+		if (sy == lastsy)
+		{
+			memcpy (dest, dest - destpitch, viewwidth);
+			continue;
+		}
+		const BYTE *line = src + sy * srcpitch;
+		for (int x = 0; x < viewwidth; ++x)
+		{
+			dest[x] = line[xmap[x]];
+		}
+		lastsy = sy;
+	}
+	DynamicCanvas->Unlock ();
+}
+
 //===========================================================================
 //
 // Render the view 
@@ -108,7 +234,21 @@ void FSoftwareRenderer::PrecacheTexture(FTexture *tex, int cache)
 
 void FSoftwareRenderer::RenderView(player_t *player)
 {
-	R_RenderActorView (player->mo);
+	double scale = R_GetDynamicScale ();
+
+	// Accelerated player sprites are positioned for the real view size.
+	if (scale < 1 && viewactive && !screen->Accel2D)
+	{
+		R_RenderDynamicView (player->mo, scale);
+	}
+	else
+	{
+		R_UnscaleWindow ();
+		R_RenderActorView (player->mo);
+	}
+	// Only the drawing stages count, so that neither the stretch nor the
+	// camera textures below feed back into the scale.
+	DynamicViewTime = WallCycles.TimeMS() + PlaneCycles.TimeMS() + MaskedCycles.TimeMS();
 	// [RH] Let cameras draw onto textures that were visible this frame.
 	FCanvasTextureInfo::UpdateAll ();
 }
@@ -174,6 +314,17 @@ int FSoftwareRenderer::GetMaxViewPitch(bool down)
 	return down ? MAX_DN_ANGLE : MAX_UP_ANGLE;
 }
 
+//==========================================================================
+//
+// CleanLevelData
+//
+//==========================================================================
+
+void FSoftwareRenderer::CleanLevelData()
+{
+	R_ClearSkyboxCache ();
+}
+
 //==========================================================================
 //
 // OnModeSet
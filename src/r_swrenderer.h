@@ -5,6 +5,8 @@
 
 struct FSoftwareRenderer : public FRenderer
 {
+	~FSoftwareRenderer();
+
 	// Can be overridden so that the colormaps for sector color/fade won't be built.
 	virtual bool UsesColormap() const;
 
@@ -25,6 +27,9 @@ struct FSoftwareRenderer : public FRenderer
 
 	virtual int GetMaxViewPitch(bool down);
 
+	// frees everything that refers to the current level
+	virtual void CleanLevelData();
+
 	void OnModeSet ();
 	void ErrorCleanup ();
 	void ClearBuffer(int color);
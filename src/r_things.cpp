@@ -64,6 +64,8 @@
 #include "r_data/voxels.h"
 #include "p_local.h"
 #include "p_maputl.h"
+#include "r_thread.h"
+#include "stats.h"
 
 // [RH] A c-buffer. Used for keeping track of offscreen voxel spans.
 
@@ -135,6 +137,13 @@ int OffscreenBufferWidth, OffscreenBufferHeight;
 BYTE *OffscreenColorBuffer;
 FCoverageBuffer *OffscreenCoverageBuffer;
 
+cycle_t VoxelCycles;
+static int NumVoxelsDrawn;
+
+// Voxels at least this many columns wide are drawn by all render threads,
+// each one taking a part of the columns.
+#define MIN_SLICED_VOXEL_WIDTH	48
+
 //
 
 // GAME FUNCTIONS
@@ -149,6 +158,10 @@ bool			DrewAVoxel;
 
 static vissprite_t **spritesorter;
 static int spritesortersize = 0;
+
+#define DSBUCKETSHIFT 5		// 32 columns per bucket
+static TArray<drawseg_t *> DrawsegBuckets[(MAXWIDTH >> DSBUCKETSHIFT) + 1];
+static TArray<drawseg_t *> SpriteDrawsegs;
 static int vsprcount;
 
 static void R_ProjectWallSprite(AActor *thing, fixed_t fx, fixed_t fy, fixed_t fz, FTextureID picnum, fixed_t xscale, fixed_t yscale, INTBOOL flip);
@@ -197,6 +210,8 @@ void R_ClearSprites (void)
 {
 	vissprite_p = firstvissprite;
 	DrewAVoxel = false;
+	VoxelCycles.Reset();
+	NumVoxelsDrawn = 0;
 }
 
 
@@ -648,6 +663,37 @@ void R_WallSpriteColumn (void (*drawfunc)(const BYTE *column, const FTexture::Sp
 	rw_light += rw_lightstep;
 }
 
+struct FVoxelSliceArgs
+{
+	vissprite_t *Sprite;
+	int MinSlabZ, MaxSlabZ;
+	short *ClipTop, *ClipBot;
+	int Flags;
+};
+
+//==========================================================================
+//
+// R_DrawVoxelSlice
+//
+// Draws one part of the columns covered by a voxel. Every slice walks
+// all the slabs in the same order, so each column still gets them back
+// to front.
+//
+//==========================================================================
+
+static void R_DrawVoxelSlice(int slice, int numslices, void *data)
+{
+	const FVoxelSliceArgs *args = (const FVoxelSliceArgs *)data;
+	const vissprite_t *spr = args->Sprite;
+	int width = spr->x2 - spr->x1;
+	int minx = slice == 0 ? 0 : spr->x1 + width * slice / numslices;
+	int maxx = slice == numslices - 1 ? viewwidth : spr->x1 + width * (slice + 1) / numslices;
+
+	R_DrawVoxel(spr->vx, spr->vy, spr->vz, spr->vang, spr->gx, spr->gy, spr->gz, spr->angle,
+		spr->xscale, spr->yscale, spr->voxel, args->ClipTop, args->ClipBot,
+		args->MinSlabZ, args->MaxSlabZ, args->Flags, minx, maxx);
+}
+
 void R_DrawVisVoxel(vissprite_t *spr, int minslabz, int maxslabz, short *cliptop, short *clipbot)
 {
 	ESPSResult mode;
@@ -678,10 +724,24 @@ void R_DrawVisVoxel(vissprite_t *spr, int minslabz, int maxslabz, short *cliptop
 		flags |= DVF_MIRRORED;
 	}
 
+	VoxelCycles.Clock();
+	NumVoxelsDrawn++;
+	R_SetupDrawSlab(spr->Style.colormap);
+
 	// Render the voxel, either directly to the screen or offscreen.
-	R_DrawVoxel(spr->vx, spr->vy, spr->vz, spr->vang, spr->gx, spr->gy, spr->gz, spr->angle,
-		spr->xscale, spr->yscale, spr->voxel, spr->Style.colormap, cliptop, clipbot,
-		minslabz, maxslabz, flags);
+	// Only the direct path can be split between threads, because the
+	// offscreen one goes through the dc_* globals.
+	if ((flags & ~DVF_MIRRORED) == 0 && spr->x2 - spr->x1 >= MIN_SLICED_VOXEL_WIDTH && R_GetSliceCount() > 1)
+	{
+		FVoxelSliceArgs args = { spr, minslabz, maxslabz, cliptop, clipbot, flags };
+		R_RunSliced(R_DrawVoxelSlice, &args);
+	}
+	else
+	{
+		R_DrawVoxel(spr->vx, spr->vy, spr->vz, spr->vang, spr->gx, spr->gy, spr->gz, spr->angle,
+			spr->xscale, spr->yscale, spr->voxel, cliptop, clipbot,
+			minslabz, maxslabz, flags, 0, viewwidth);
+	}
 
 	// Blend the voxel, if that's what we need to do.
 	if ((flags & ~DVF_MIRRORED) != 0)
@@ -718,10 +778,19 @@ void R_DrawVisVoxel(vissprite_t *spr, int minslabz, int maxslabz, short *cliptop
 		}
 	}
 
+	VoxelCycles.Unclock();
+
 	R_FinishSetPatchStyle();
 	NetUpdate();
 }
 
+ADD_STAT(voxels)
+{
+	FString out;
+	out.Format("%d voxels drawn in %04.2f ms, %d render threads", NumVoxelsDrawn, VoxelCycles.TimeMS(), R_GetSliceCount());
+	return out;
+}
+
 //
 // R_ProjectSprite
 // Generates a vissprite for a thing if it might be visible.
@@ -1835,6 +1904,50 @@ void R_SplitVisSprites ()
 }
 #endif
 
+//==========================================================================
+//
+// R_RadixSortVisSprites
+//
+// Same result as std::stable_sort with sv_compare, but in linear time.
+// Radix sorting is stable, so sprites at equal depth keep their order.
+//
+//==========================================================================
+
+static void R_RadixSortVisSprites ()
+{
+	static TArray<vissprite_t *> temp;
+	vissprite_t **src = spritesorter;
+	vissprite_t **dest;
+
+	temp.Resize (vsprcount);
+	dest = &temp[0];
+
+	// Sort by descending idepth: flip the sign bit so that the signed
+	// value sorts as unsigned, then invert so larger values come first.
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		int counts[257] = { 0 };
+		int i;
+
+		for (i = 0; i < vsprcount; ++i)
+		{
+			DWORD key = ~((DWORD)src[i]->idepth ^ 0x80000000u);
+			counts[((key >> shift) & 0xff) + 1]++;
+		}
+		for (i = 1; i < 256; ++i)
+		{
+			counts[i] += counts[i - 1];
+		}
+		for (i = 0; i < vsprcount; ++i)
+		{
+			DWORD key = ~((DWORD)src[i]->idepth ^ 0x80000000u);
+			dest[counts[(key >> shift) & 0xff]++] = src[i];
+		}
+		swapvalues (src, dest);
+	}
+	// After an even number of passes the result is back in spritesorter.
+}
+
 #ifdef __GNUC__
 static void swap(vissprite_t *&a, vissprite_t *&b)
 {
@@ -1880,7 +1993,108 @@ void R_SortVisSprites (bool (*compare)(vissprite_t *, vissprite_t *), size_t fir
 		}
 	}
 
-	std::stable_sort(&spritesorter[0], &spritesorter[vsprcount], compare);
+	if (compare == sv_compare && vsprcount > 64)
+	{
+		R_RadixSortVisSprites ();
+	}
+	else
+	{
+		std::stable_sort(&spritesorter[0], &spritesorter[vsprcount], compare);
+	}
+}
+
+//==========================================================================
+//
+// R_BuildDrawsegIndex
+//
+// Sorts the drawsegs that can affect sprites into buckets of screen
+// columns, so that R_DrawSprite only has to look at the ones that overlap
+// the sprite instead of all of them. Every bucket lists its drawsegs in
+// drawseg order. Called by R_DrawMasked every time firstdrawseg..ds_p
+// may have changed.
+//
+//==========================================================================
+
+static void R_BuildDrawsegIndex ()
+{
+	int numbuckets = (viewwidth >> DSBUCKETSHIFT) + 1;
+
+	for (int i = 0; i < numbuckets; ++i)
+	{
+		DrawsegBuckets[i].Clear ();
+	}
+	for (drawseg_t *ds = firstdrawseg; ds < ds_p; ++ds)
+	{
+		// kg3D - no clipping on fake segs
+		if (ds->fake)
+			continue;
+		if (!(ds->silhouette & SIL_BOTH) && ds->maskedtexturecol == -1 && !ds->bFogBoundary)
+			continue;
+
+		int b1 = MAX<int> (ds->x1, 0) >> DSBUCKETSHIFT;
+		int b2 = MIN<int> (ds->x2, viewwidth) >> DSBUCKETSHIFT;
+		for (int b = b1; b <= b2; ++b)
+		{
+			DrawsegBuckets[b].Push (ds);
+		}
+	}
+}
+
+//==========================================================================
+//
+// R_GetSpriteDrawsegs
+//
+// Fills SpriteDrawsegs with every drawseg that might overlap columns
+// [x1, x2), from last to first, which is the order R_DrawSprite has always
+// scanned them in. The buckets are merged by always taking the highest
+// drawseg next; a drawseg in more than one bucket comes up several times
+// in a row and is only added once.
+//
+//==========================================================================
+
+static void R_GetSpriteDrawsegs (int x1, int x2)
+{
+	int b1 = MAX (x1, 0) >> DSBUCKETSHIFT;
+	int b2 = MIN (x2 - 1, viewwidth) >> DSBUCKETSHIFT;
+	int numlists = b2 - b1 + 1;
+
+	SpriteDrawsegs.Clear ();
+	if (numlists > 8)
+	{
+		for (drawseg_t *ds = ds_p; ds-- > firstdrawseg; )
+		{
+			SpriteDrawsegs.Push (ds);
+		}
+		return;
+	}
+
+	int pos[8];
+	for (int i = 0; i < numlists; ++i)
+	{
+		pos[i] = DrawsegBuckets[b1 + i].Size();
+	}
+	drawseg_t *last = NULL;
+	for (;;)
+	{
+		int best = -1;
+		drawseg_t *bestds = NULL;
+		for (int i = 0; i < numlists; ++i)
+		{
+			if (pos[i] > 0 && DrawsegBuckets[b1 + i][pos[i] - 1] > bestds)
+			{
+				best = i;
+				bestds = DrawsegBuckets[b1 + i][pos[i] - 1];
+			}
+		}
+		if (best < 0)
+			break;
+		pos[best]--;
+		if (bestds != last)
+		{
+			SpriteDrawsegs.Push (bestds);
+			last = bestds;
+		}
+	}
 }
 
 //
@@ -2175,8 +2389,11 @@ void R_DrawSprite (vissprite_t *spr)
 
 	//		for (ds=ds_p-1 ; ds >= drawsegs ; ds--)    old buggy code
 
-	for (ds = ds_p; ds-- > firstdrawseg; )  // new -- killough
+	R_GetSpriteDrawsegs (x1, x2);
+	for (unsigned int dsi = 0; dsi < SpriteDrawsegs.Size(); ++dsi)
 	{
+		ds = SpriteDrawsegs[dsi];
+
 		// [ZZ] portal handling here
 		//if (ds->CurrentPortalUniq != spr->CurrentPortalUniq)
 		//	continue;
@@ -2356,6 +2573,7 @@ void R_DrawMasked (void)
 {
 	R_CollectPortals();
 	R_SortVisSprites (DrewAVoxel ? sv_compare2d : sv_compare, firstvissprite - vissprites);
+	R_BuildDrawsegIndex ();
 
 	if (height_top == NULL)
 	{ // kg3D - no visible 3D floors, normal rendering
@@ -2666,7 +2884,7 @@ extern fixed_t baseyaspectmul;
 void R_DrawVoxel(fixed_t globalposx, fixed_t globalposy, fixed_t globalposz, angle_t viewang,
 	fixed_t dasprx, fixed_t daspry, fixed_t dasprz, angle_t dasprang,
 	fixed_t daxscale, fixed_t dayscale, FVoxel *voxobj,
-	lighttable_t *colormap, short *daumost, short *dadmost, int minslabz, int maxslabz, int flags)
+	short *daumost, short *dadmost, int minslabz, int maxslabz, int flags, int minx, int maxx)
 {
 	int i, j, k, x, y, syoff, ggxstart, ggystart, nxoff;
 	fixed_t cosang, sinang, sprcosang, sprsinang;
@@ -2702,8 +2920,6 @@ void R_DrawVoxel(fixed_t globalposx, fixed_t globalposy, fixed_t globalposz, ang
 	sprcosang = finecosine[dasprang >> ANGLETOFINESHIFT] >> 2;
 	sprsinang = -finesine[dasprang >> ANGLETOFINESHIFT] >> 2;
 
-	R_SetupDrawSlab(colormap);
-
 	// Select mip level
 	i = abs(DMulScale6(dasprx - globalposx, cosang, daspry - globalposy, sinang));
 	i = DivScale6(i, MIN(daxscale, dayscale));
@@ -2851,6 +3067,9 @@ void R_DrawVoxel(fixed_t globalposx, fixed_t globalposy, fixed_t globalposz, ang
 					lx = viewwidth - rx;
 					rx = t;
 				}
+				if (lx < minx) lx = minx;
+				if (rx > maxx) rx = maxx;
+				if (rx <= lx) continue;
 
 				fixed_t l1 = xs_RoundToInt(centerxwidebig_f / (ny - yoff));
 				fixed_t l2 = xs_RoundToInt(centerxwidebig_f / (ny + yoff));
@@ -0,0 +1,197 @@
+/*
+** r_thread.cpp
+** Worker threads for the software renderer
+**
+** The workers are started the first time they are needed and stay around
+** until the thread count changes or the renderer shuts down. Each call to
+** R_RunSliced wakes them up, lets every one of them run one slice of the
+** job and blocks until the last one is done.
+**
+*/
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "templates.h"
+#include "doomtype.h"
+#include "c_cvars.h"
+#include "i_system.h"
+#include "r_thread.h"
+
+#define MAX_RENDER_THREADS	16
+
+CVAR (Bool, r_multithreaded, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+CUSTOM_CVAR (Int, r_threadcount, 0, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0)
+	{
+		self = 0;
+	}
+	else if (self > MAX_RENDER_THREADS)
+	{
+		self = MAX_RENDER_THREADS;
+	}
+}
+
+static std::thread Workers[MAX_RENDER_THREADS];
+static int NumWorkers;			// Does not include the main thread
+static bool Registered;
+
+static std::mutex JobLock;
+static std::condition_variable JobStart;
+static std::condition_variable JobDone;
+static unsigned int JobGeneration;
+static int JobsPending;
+static bool ShuttingDown;
+
+static RenderSliceFunc JobFunc;
+static void *JobData;
+static int JobSlices;
+
+//==========================================================================
+//
+// WorkerMain
+//
+//==========================================================================
+
+static void WorkerMain (int slice, unsigned int seen)
+{
+	for (;;)
+	{
+		RenderSliceFunc func;
+		void *data;
+		int numslices;
+
+		{
+			std::unique_lock<std::mutex> lock(JobLock);
+			JobStart.wait(lock, [&] { return ShuttingDown || JobGeneration != seen; });
+			if (ShuttingDown)
+			{
+				return;
+			}
+			seen = JobGeneration;
+			func = JobFunc;
+			data = JobData;
+			numslices = JobSlices;
+		}
+
+		if (slice < numslices)
+		{
+			func(slice, numslices, data);
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(JobLock);
+			if (--JobsPending == 0)
+			{
+				JobDone.notify_one();
+			}
+		}
+	}
+}
+
+//==========================================================================
+//
+// R_ShutdownThreads
+//
+//==========================================================================
+
+void R_ShutdownThreads ()
+{
+	if (NumWorkers == 0)
+	{
+		return;
+	}
+	{
+		std::unique_lock<std::mutex> lock(JobLock);
+		ShuttingDown = true;
+	}
+	JobStart.notify_all();
+	for (int i = 0; i < NumWorkers; ++i)
+	{
+		Workers[i].join();
+	}
+	NumWorkers = 0;
+	ShuttingDown = false;
+}
+
+//==========================================================================
+//
+// R_GetSliceCount
+//
+//==========================================================================
+
+int R_GetSliceCount ()
+{
+	if (!r_multithreaded)
+	{
+		return 1;
+	}
+	int count = r_threadcount;
+	if (count == 0)
+	{
+		count = (int)std::thread::hardware_concurrency();
+	}
+	return clamp(count, 1, MAX_RENDER_THREADS);
+}
+
+//==========================================================================
+//
+// StartWorkers
+//
+// Makes sure there are exactly count-1 worker threads waiting for jobs.
+//
+//==========================================================================
+
+static void StartWorkers (int count)
+{
+	if (NumWorkers == count - 1)
+	{
+		return;
+	}
+	R_ShutdownThreads();
+	if (!Registered)
+	{
+		atterm(R_ShutdownThreads);
+		Registered = true;
+	}
+	for (int i = 0; i < count - 1; ++i)
+	{
+		Workers[i] = std::thread(WorkerMain, i + 1, JobGeneration);
+	}
+	NumWorkers = count - 1;
+}
+
+//==========================================================================
+//
+// R_RunSliced
+//
+//==========================================================================
+
+void R_RunSliced (RenderSliceFunc func, void *userdata)
+{
+	int count = R_GetSliceCount();
+
+	if (count <= 1)
+	{
+		func(0, 1, userdata);
+		return;
+	}
+
+	StartWorkers(count);
+	{
+		std::unique_lock<std::mutex> lock(JobLock);
+		JobFunc = func;
+		JobData = userdata;
+		JobSlices = count;
+		JobsPending = NumWorkers;
+		JobGeneration++;
+	}
+	JobStart.notify_all();
+
+	func(0, count, userdata);
+
+	std::unique_lock<std::mutex> lock(JobLock);
+	JobDone.wait(lock, [] { return JobsPending == 0; });
+}
@@ -0,0 +1,25 @@
+#ifndef __R_THREAD_H
+#define __R_THREAD_H
+
+//
+// Worker threads for the software renderer.
+//
+// Work is handed out in slices: every slice receives its index and the
+// total number of slices and is expected to only touch the part of the
+// frame buffer that belongs to it (e.g. every n-th row). The calling
+// thread always runs slice 0 itself and does not return until all slices
+// have finished, so callers never need to synchronize on their own.
+//
+
+typedef void (*RenderSliceFunc)(int slice, int numslices, void *userdata);
+
+// Returns the number of slices R_RunSliced will split work into. This is
+// 1 if threading is disabled.
+int R_GetSliceCount ();
+
+// Runs func once for every slice and waits for all of them to finish.
+void R_RunSliced (RenderSliceFunc func, void *userdata);
+
+void R_ShutdownThreads ();
+
+#endif
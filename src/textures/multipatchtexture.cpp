@@ -51,6 +51,7 @@
 #include "m_fixed.h"
 #include "textures/textures.h"
 #include "r_data/colormaps.h"
+#include "c_cvars.h"
 
 // On the Alpha, accessing the shorts directly if they aren't aligned on a
 // 4-byte boundary causes unaligned access warnings. Why it does this at
@@ -192,11 +193,44 @@ protected:
 
 	void MakeTexture ();
 
+	unsigned int LastUsed;		// CompositeFrame this was last drawn in
+	int CachedSize;
+	FMultiPatchTexture *CacheNext, *CachePrev;	// Composite cache, most recently used first
+
+	void LinkComposite ();
+	void UnlinkComposite ();
+	void TouchComposite ();
+
+	friend class FTextureManager;
+
 private:
 	void CheckForHacks ();
 	void ParsePatch(FScanner &sc, TexPart & part, bool silent, int usetype);
 };
 
+//==========================================================================
+//
+// Composite texture cache
+//
+// Every composited texture stays loaded once it has been built. This keeps
+// track of them so that TrimCompositeCache can unload the ones that have
+// not been seen for a while when r_texturecache (in megabytes) is exceeded.
+// Nothing used in the last couple of frames is ever unloaded, so the walls
+// in view are never rebuilt in the middle of drawing them. 0 never unloads
+// anything.
+//
+// The loaded textures are kept in a list with the most recently used one
+// first. A texture moves to the front the first time it is used in a
+// frame, so trimming only needs to look at the end of the list.
+//
+//==========================================================================
+
+CVAR (Int, r_texturecache, 64, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
+static FMultiPatchTexture *CompositeHead, *CompositeTail;
+static size_t CompositeBytes;
+static unsigned int CompositeFrame;
+
 //==========================================================================
 //
 // FMultiPatchTexture :: FMultiPatchTexture
@@ -204,7 +238,7 @@ private:
 //==========================================================================
 
 FMultiPatchTexture::FMultiPatchTexture (const void *texdef, FPatchLookup *patchlookup, int maxpatchnum, bool strife, int deflumpnum)
-: Pixels (0), Spans(0), Parts(0), bRedirect(false), bTranslucentPatches(false)
+: Pixels (0), Spans(0), Parts(0), bRedirect(false), bTranslucentPatches(false), LastUsed(0), CachedSize(0), CacheNext(NULL), CachePrev(NULL)
 {
 	union
 	{
@@ -361,6 +395,79 @@ void FMultiPatchTexture::Unload ()
 	{
 		delete[] Pixels;
 		Pixels = NULL;
+
+		UnlinkComposite ();
+		CompositeBytes -= CachedSize;
+		CachedSize = 0;
+	}
+}
+
+//==========================================================================
+//
+// FMultiPatchTexture :: LinkComposite
+//
+//==========================================================================
+
+void FMultiPatchTexture::LinkComposite ()
+{
+	CachePrev = NULL;
+	CacheNext = CompositeHead;
+	if (CompositeHead != NULL)
+	{
+		CompositeHead->CachePrev = this;
+	}
+	else
+	{
+		CompositeTail = this;
+	}
+	CompositeHead = this;
+}
+
+//==========================================================================
+//
+// FMultiPatchTexture :: UnlinkComposite
+//
+//==========================================================================
+
+void FMultiPatchTexture::UnlinkComposite ()
+{
+	if (CachePrev != NULL)
+	{
+		CachePrev->CacheNext = CacheNext;
+	}
+	else
+	{
+		CompositeHead = CacheNext;
+	}
+	if (CacheNext != NULL)
+	{
+		CacheNext->CachePrev = CachePrev;
+	}
+	else
+	{
+		CompositeTail = CachePrev;
+	}
+	CacheNext = CachePrev = NULL;
+}
+
+//==========================================================================
+//
+// FMultiPatchTexture :: TouchComposite
+//
+// Marks the texture as used in this frame.
+//
+//==========================================================================
+
+inline void FMultiPatchTexture::TouchComposite ()
+{
+	if (LastUsed != CompositeFrame)
+	{
+		LastUsed = CompositeFrame;
+		if (CompositeHead != this)
+		{
+			UnlinkComposite ();
+			LinkComposite ();
+		}
 	}
 }
 
@@ -380,6 +487,7 @@ const BYTE *FMultiPatchTexture::GetPixels ()
 	{
 		MakeTexture ();
 	}
+	TouchComposite ();
 	return Pixels;
 }
 
@@ -399,6 +507,7 @@ const BYTE *FMultiPatchTexture::GetColumn (unsigned int column, const Span **spa
 	{
 		MakeTexture ();
 	}
+	TouchComposite ();
 	if ((unsigned)column >= (unsigned)Width)
 	{
 		if (WidthMask + 1 == Width)
@@ -493,6 +602,9 @@ void FMultiPatchTexture::MakeTexture ()
 
 	Pixels = new BYTE[numpix];
 	memset (Pixels, 0, numpix);
+	CachedSize = numpix;
+	CompositeBytes += numpix;
+	LinkComposite ();
 
 	for (int i = 0; i < NumParts; ++i)
 	{
@@ -544,6 +656,33 @@ void FMultiPatchTexture::MakeTexture ()
 	}
 }
 
+//==========================================================================
+//
+// FTextureManager :: TrimCompositeCache
+//
+// Called once per frame before anything is drawn.
+//
+//==========================================================================
+
+void FTextureManager::TrimCompositeCache ()
+{
+	CompositeFrame++;
+
+	if (r_texturecache <= 0 || CompositeBytes <= (size_t)r_texturecache * 1024 * 1024)
+	{
+		return;
+	}
+
+	while (CompositeTail != NULL && CompositeBytes > (size_t)r_texturecache * 1024 * 1024)
+	{
+		if (CompositeFrame - CompositeTail->LastUsed <= 2)
+		{
+			break;
+		}
+		CompositeTail->Unload ();
+	}
+}
+
 //===========================================================================
 //
 // FMultipatchTexture::CopyTrueColorPixels
@@ -1204,7 +1343,7 @@ void FMultiPatchTexture::ParsePatch(FScanner &sc, TexPart & part, bool silent, i
 //==========================================================================
 
 FMultiPatchTexture::FMultiPatchTexture (FScanner &sc, int usetype)
-: Pixels (0), Spans(0), Parts(0), bRedirect(false), bTranslucentPatches(false)
+: Pixels (0), Spans(0), Parts(0), bRedirect(false), bTranslucentPatches(false), LastUsed(0), CachedSize(0), CacheNext(NULL), CachePrev(NULL)
 {
 	TArray<TexPart> parts;
 	bool bSilent = false;
@@ -378,6 +378,12 @@ public:
 
 	void UnloadAll ();
 
+	// Unloads the least recently used composited textures if they take up
+	// more memory than r_texturecache allows. Must only be called between
+	// frames, since column pointers handed out during a frame are not
+	// allowed to go away.
+	void TrimCompositeCache ();
+
 	int NumTextures () const { return (int)Textures.Size(); }
 	void PrecacheLevel (void);
 
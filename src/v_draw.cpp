@@ -119,6 +119,106 @@ void STACK_ARGS DCanvas::DrawTexture (FTexture *img, double x, double y, int tag
 	DrawTextureParms(img, parms);
 }
 
+void DCanvas::DrawTexture (FTexture *img, const DrawParms &parms)
+{
+	DrawParms finished = parms;
+
+	if (FinishDrawParms(&finished))
+	{
+		DrawTextureParms(img, finished);
+	}
+}
+
+#ifndef NO_SWRENDER
+//==========================================================================
+//
+// DrawUnmaskedRows
+//
+// Draws an image without holes one row at a time instead of one column
+// at a time. The rows and columns sampled are the same ones that
+// R_DrawMaskedColumn uses, so the output does not change. But each row
+// is stepped only once and the writes go to consecutive bytes.
+//
+// Returns false without drawing anything if the image is drawn masked
+// and turns out to have holes.
+//
+//==========================================================================
+
+static bool DrawUnmaskedRows (FTexture *img, bool masked, fixed_t frac, fixed_t xstep, int x2, int uclip, int dclip)
+{
+	static const BYTE *columns[MAXWIDTH];
+	const int height = img->GetHeight();
+	const int count = x2 - dc_x;
+	int i, y, yl, yh;
+
+	for (i = 0; i < count; ++i, frac += xstep)
+	{
+		columns[i] = img->GetColumn(frac >> FRACBITS, NULL);
+	}
+	// Some textures only know if they have holes once they have been made.
+	if (masked && img->bMasked)
+	{
+		return false;
+	}
+
+	// This is R_DrawMaskedColumn for a single post covering the column.
+	yl = sprtopscreen >> FRACBITS;
+	yh = (sprtopscreen + spryscale * height - FRACUNIT) >> FRACBITS;
+	if (yh >= dclip)
+	{
+		yh = dclip - 1;
+	}
+	if (yl < uclip)
+	{
+		yl = uclip;
+	}
+	if (yl > yh)
+	{
+		return true;
+	}
+
+	fixed_t vfrac = dc_texturemid + yl*dc_iscale - FixedMul(centeryfrac-FRACUNIT, dc_iscale);
+	while (vfrac < 0)
+	{
+		if (++yl > yh)
+			return true;
+		vfrac += dc_iscale;
+	}
+	fixed_t endfrac = vfrac + (yh-yl)*dc_iscale;
+	const fixed_t maxfrac = height << FRACBITS;
+	if (yh < dclip-1 && endfrac < maxfrac - dc_iscale)
+	{
+		yh++;
+	}
+	else while (endfrac >= maxfrac)
+	{
+		if (--yh < yl)
+			return true;
+		endfrac -= dc_iscale;
+	}
+
+	const BYTE *colormap = dc_colormap;
+	for (y = yl; y <= yh; ++y, vfrac += dc_iscale)
+	{
+		BYTE *dest = ylookup[y] + dc_x + dc_destorg;
+		int v = vfrac >> FRACBITS;
+
+		for (i = 0; i <= count - 4; i += 4)
+		{
+			dest[i+0] = colormap[columns[i+0][v]];
+			dest[i+1] = colormap[columns[i+1][v]];
+			dest[i+2] = colormap[columns[i+2][v]];
+			dest[i+3] = colormap[columns[i+3][v]];
+		}
+		for (; i < count; ++i)
+		{
+			dest[i] = colormap[columns[i][v]];
+		}
+	}
+	return true;
+}
+#endif
+
 void DCanvas::DrawTextureParms(FTexture *img, DrawParms &parms)
 {
 #ifndef NO_SWRENDER
@@ -286,7 +386,12 @@ void DCanvas::DrawTextureParms(FTexture *img, DrawParms &parms)
 			stop4 = x2_i & ~3;
 		}
 
-		if (dc_x < x2_i)
+		bool drawn = false;
+		if (dc_x < x2_i && colfunc == basecolfunc && (spanptr == NULL || !img->bMasked))
+		{ // Plain copy of an image without holes
+			drawn = DrawUnmaskedRows(img, spanptr != NULL, frac, xiscale_i, x2_i, parms.uclip, parms.dclip);
+		}
+		if (!drawn && dc_x < x2_i)
 		{
 			while ((dc_x < stop4) && (dc_x & 3))
 			{
@@ -330,28 +435,30 @@ void DCanvas::DrawTextureParms(FTexture *img, DrawParms &parms)
 #endif
 }
 
-bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag, va_list tags, DrawParms *parms, bool fortext) const
-{
-	INTBOOL boolval;
-	int intval;
-	bool translationset = false;
-	bool virtBottom;
-	bool fillcolorset = false;
+//==========================================================================
+//
+// DCanvas :: InitDrawParms
+//
+// Sets parms to what DrawTexture uses when there are no tags. Returns
+// false if the texture cannot be drawn at all.
+//
+//==========================================================================
 
+bool DCanvas::InitDrawParms (FTexture *img, double x, double y, DrawParms *parms) const
+{
 	if (img == NULL || img->UseType == FTexture::TEX_Null)
 	{
-		va_end(tags);
 		return false;
 	}
 
 	// Do some sanity checks on the coordinates.
 	if (x < -16383 || x > 16383 || y < -16383 || y > 16383)
 	{
-		va_end(tags);
 		return false;
 	}
 
-	virtBottom = false;
+	parms->virtBottom = false;
+	parms->fillcolorset = false;
 
 	parms->texwidth = img->GetScaledWidthDouble();
 	parms->texheight = img->GetScaledHeightDouble();
@@ -386,50 +493,203 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 
 	parms->x = x;
 	parms->y = y;
+	return true;
+}
+
+bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag, va_list tags, DrawParms *parms, bool fortext) const
+{
+	if (!InitDrawParms(img, x, y, parms))
+	{
+		va_end(tags);
+		return false;
+	}
+	{
+		FDrawTagReader reader(tag, tags);
+		ParseDrawTags(img, reader, parms);
+	}
+	va_end(tags);
+
+	return FinishDrawParms(parms);
+}
+
+//==========================================================================
+//
+// FDrawTagReader
+//
+//==========================================================================
+
+FDrawTagReader::FDrawTagReader (va_list tags, FDrawTagList *record)
+{
+	Init (tags, record);
+	HasFirst = false;
+}
+
+FDrawTagReader::FDrawTagReader (uint32 first, va_list tags, FDrawTagList *record)
+{
+	Init (tags, record);
+	HasFirst = true;
+	First = first;
+}
+
+FDrawTagReader::FDrawTagReader (const FDrawTagList &list)
+{
+	HasTags = HasFirst = false;
+	Record = NULL;
+	List = &list;
+	Pos = 0;
+}
+
+void FDrawTagReader::Init (va_list tags, FDrawTagList *record)
+{
+#ifndef NO_VA_COPY
+	va_copy (Tags, tags);
+#else
+	Tags = tags;
+#endif
+	HasTags = true;
+	Record = record;
+	List = NULL;
+	Pos = 0;
+	if (Record != NULL)
+	{
+		Record->NumValues = 0;
+		Record->Complete = Record->Overflow = false;
+	}
+}
+
+FDrawTagReader::~FDrawTagReader ()
+{
+	if (HasTags)
+	{
+		va_end (Tags);
+	}
+}
+
+// Each of these reads the next value from the list, with the type the
+// caller of va_arg would have used.
+#define READ_TAG_VALUE(member, type) \
+	if (List != NULL) \
+	{ \
+		return List->Values[Pos++].member; \
+	} \
+	type val = va_arg (Tags, type); \
+	if (Record != NULL && !Record->Overflow) \
+	{ \
+		if (Record->NumValues == FDrawTagList::MAX_VALUES) \
+			Record->Overflow = true; \
+		else \
+			Record->Values[Record->NumValues++].member = val; \
+	} \
+	return val;
+
+int FDrawTagReader::Int ()
+{
+	READ_TAG_VALUE(Int, int)
+}
+
+uint32 FDrawTagReader::UInt ()
+{
+	READ_TAG_VALUE(UInt, uint32)
+}
+
+double FDrawTagReader::Float ()
+{
+	READ_TAG_VALUE(Float, double)
+}
+
+void *FDrawTagReader::Ptr ()
+{
+	READ_TAG_VALUE(Ptr, void *)
+}
+
+#undef READ_TAG_VALUE
+
+uint32 FDrawTagReader::Tag ()
+{
+	if (List != NULL)
+	{
+		return List->Values[Pos++].UInt;
+	}
+
+	uint32 tag;
+	if (HasFirst)
+	{
+		HasFirst = false;
+		tag = First;
+	}
+	else
+	{
+		tag = va_arg (Tags, uint32);
+	}
+	while (tag == TAG_MORE)
+	{
+		va_list *more_p = va_arg (Tags, va_list *);
+		va_end (Tags);
+#ifndef NO_VA_COPY
+		va_copy (Tags, *more_p);
+#else
+		Tags = *more_p;
+#endif
+		tag = va_arg (Tags, uint32);
+	}
+	if (Record != NULL && !Record->Overflow)
+	{
+		if (Record->NumValues == FDrawTagList::MAX_VALUES)
+		{
+			Record->Overflow = true;
+		}
+		else
+		{
+			Record->Values[Record->NumValues++].UInt = tag;
+			Record->Complete = tag == TAG_DONE;
+		}
+	}
+	return tag;
+}
+
+//==========================================================================
+//
+// DCanvas :: ParseDrawTags
+//
+// Applies a tag list to parms that InitDrawParms has filled in.
+//
+//==========================================================================
+
+void DCanvas::ParseDrawTags (FTexture *img, FDrawTagReader &tags, DrawParms *parms) const
+{
+	INTBOOL boolval;
+	int intval;
 
 	// Parse the tag list for attributes. (For floating point attributes,
 	// consider that the C ABI dictates that all floats be promoted to
 	// doubles when passed as function arguments.)
-	while (tag != TAG_DONE)
+	for (DWORD tag = tags.Tag(); tag != TAG_DONE; tag = tags.Tag())
 	{
-		va_list *more_p;
-		DWORD data;
-
 		switch (tag)
 		{
 		case TAG_IGNORE:
 		default:
-			data = va_arg(tags, DWORD);
-			break;
-
-		case TAG_MORE:
-			more_p = va_arg(tags, va_list *);
-			va_end (tags);
-#ifndef NO_VA_COPY
-			va_copy (tags, *more_p);
-#else
-			tags = *more_p;
-#endif
+			tags.UInt();
 			break;
 
 		case DTA_DestWidth:
-			parms->destwidth = va_arg(tags, int);
+			parms->destwidth = tags.Int();
 			break;
 
 		case DTA_DestWidthF:
-			parms->destwidth = va_arg(tags, double);
+			parms->destwidth = tags.Float();
 			break;
 
 		case DTA_DestHeight:
-			parms->destheight = va_arg(tags, int);
+			parms->destheight = tags.Int();
 			break;
 
 		case DTA_DestHeightF:
-			parms->destheight = va_arg(tags, double);
+			parms->destheight = tags.Float();
 			break;
 
 		case DTA_Clean:
-			boolval = va_arg(tags, INTBOOL);
+			boolval = tags.Int();
 			if (boolval)
 			{
 				parms->x = (parms->x - 160.0) * CleanXfac + (Width * 0.5);
@@ -440,7 +700,7 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_CleanNoMove:
-			boolval = va_arg(tags, INTBOOL);
+			boolval = tags.Int();
 			if (boolval)
 			{
 				parms->destwidth = parms->texwidth * CleanXfac;
@@ -449,7 +709,7 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_CleanNoMove_1:
-			boolval = va_arg(tags, INTBOOL);
+			boolval = tags.Int();
 			if (boolval)
 			{
 				parms->destwidth = parms->texwidth * CleanXfac_1;
@@ -458,7 +718,7 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_320x200:
-			boolval = va_arg(tags, INTBOOL);
+			boolval = tags.Int();
 			if (boolval)
 			{
 				parms->virtWidth = 320;
@@ -467,20 +727,20 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_Bottom320x200:
-			boolval = va_arg(tags, INTBOOL);
+			boolval = tags.Int();
 			if (boolval)
 			{
 				parms->virtWidth = 320;
 				parms->virtHeight = 200;
 			}
-			virtBottom = true;
+			parms->virtBottom = true;
 			break;
 
 		case DTA_HUDRules:
 			{
 				bool xright = parms->x < 0;
 				bool ybot = parms->y < 0;
-				intval = va_arg(tags, int);
+				intval = tags.Int();
 
 				if (hud_scale)
 				{
@@ -508,23 +768,23 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_VirtualWidth:
-			parms->virtWidth = va_arg(tags, int);
+			parms->virtWidth = tags.Int();
 			break;
 
 		case DTA_VirtualWidthF:
-			parms->virtWidth = va_arg(tags, double);
+			parms->virtWidth = tags.Float();
 			break;
 			
 		case DTA_VirtualHeight:
-			parms->virtHeight = va_arg(tags, int);
+			parms->virtHeight = tags.Int();
 			break;
 
 		case DTA_VirtualHeightF:
-			parms->virtHeight = va_arg(tags, double);
+			parms->virtHeight = tags.Float();
 			break;
 
 		case DTA_Fullscreen:
-			boolval = va_arg(tags, INTBOOL);
+			boolval = tags.Int();
 			if (boolval)
 			{
 				parms->x = parms->y = 0;
@@ -534,24 +794,24 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_Alpha:
-			parms->Alpha = FIXED2FLOAT(MIN<fixed_t>(OPAQUE, va_arg (tags, fixed_t)));
+			parms->Alpha = FIXED2FLOAT(MIN<fixed_t>(OPAQUE, tags.Int()));
 			break;
 
 		case DTA_AlphaF:
-			parms->Alpha = (float)(MIN<double>(1., va_arg(tags, double)));
+			parms->Alpha = (float)(MIN<double>(1., tags.Float()));
 			break;
 
 		case DTA_AlphaChannel:
-			parms->alphaChannel = va_arg(tags, INTBOOL);
+			parms->alphaChannel = tags.Int();
 			break;
 
 		case DTA_FillColor:
-			parms->fillcolor = va_arg(tags, uint32);
-			fillcolorset = true;
+			parms->fillcolor = tags.UInt();
+			parms->fillcolorset = true;
 			break;
 
 		case DTA_Translation:
-			parms->remap = va_arg(tags, FRemapTable *);
+			parms->remap = (FRemapTable *)tags.Ptr();
 			if (parms->remap != NULL && parms->remap->Inactive)
 			{ // If it's inactive, pretend we were passed NULL instead.
 				parms->remap = NULL;
@@ -559,31 +819,31 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_ColorOverlay:
-			parms->colorOverlay = va_arg(tags, DWORD);
+			parms->colorOverlay = tags.UInt();
 			break;
 
 		case DTA_FlipX:
-			parms->flipX = va_arg(tags, INTBOOL);
+			parms->flipX = tags.Int();
 			break;
 
 		case DTA_TopOffset:
-			parms->top = va_arg(tags, int);
+			parms->top = tags.Int();
 			break;
 
 		case DTA_TopOffsetF:
-			parms->top = va_arg(tags, double);
+			parms->top = tags.Float();
 			break;
 
 		case DTA_LeftOffset:
-			parms->left = va_arg(tags, int);
+			parms->left = tags.Int();
 			break;
 
 		case DTA_LeftOffsetF:
-			parms->left = va_arg(tags, double);
+			parms->left = tags.Float();
 			break;
 
 		case DTA_CenterOffset:
-			if (va_arg(tags, int))
+			if (tags.Int())
 			{
 				parms->left = parms->texwidth * 0.5;
 				parms->top = parms->texheight * 0.5;
@@ -591,7 +851,7 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_CenterBottomOffset:
-			if (va_arg(tags, int))
+			if (tags.Int())
 			{
 				parms->left = parms->texwidth * 0.5;
 				parms->top = parms->texheight;
@@ -599,23 +859,23 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_WindowLeft:
-			parms->windowleft = va_arg(tags, int);
+			parms->windowleft = tags.Int();
 			break;
 
 		case DTA_WindowLeftF:
-			parms->windowleft = va_arg(tags, double);
+			parms->windowleft = tags.Float();
 			break;
 
 		case DTA_WindowRight:
-			parms->windowright = va_arg(tags, int);
+			parms->windowright = tags.Int();
 			break;
 
 		case DTA_WindowRightF:
-			parms->windowright = va_arg(tags, double);
+			parms->windowright = tags.Float();
 			break;
 
 		case DTA_ClipTop:
-			parms->uclip = va_arg(tags, int);
+			parms->uclip = tags.Int();
 			if (parms->uclip < 0)
 			{
 				parms->uclip = 0;
@@ -623,7 +883,7 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_ClipBottom:
-			parms->dclip = va_arg(tags, int);
+			parms->dclip = tags.Int();
 			if (parms->dclip > this->GetHeight())
 			{
 				parms->dclip = this->GetHeight();
@@ -631,7 +891,7 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_ClipLeft:
-			parms->lclip = va_arg(tags, int);
+			parms->lclip = tags.Int();
 			if (parms->lclip < 0)
 			{
 				parms->lclip = 0;
@@ -639,7 +899,7 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_ClipRight:
-			parms->rclip = va_arg(tags, int);
+			parms->rclip = tags.Int();
 			if (parms->rclip > this->GetWidth())
 			{
 				parms->rclip = this->GetWidth();
@@ -647,15 +907,15 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_ShadowAlpha:
-			parms->shadowAlpha = MIN<fixed_t>(OPAQUE, va_arg (tags, fixed_t));
+			parms->shadowAlpha = MIN<fixed_t>(OPAQUE, tags.Int());
 			break;
 
 		case DTA_ShadowColor:
-			parms->shadowColor = va_arg(tags, int);
+			parms->shadowColor = tags.Int();
 			break;
 
 		case DTA_Shadow:
-			boolval = va_arg(tags, INTBOOL);
+			boolval = tags.Int();
 			if (boolval)
 			{
 				parms->shadowAlpha = FRACUNIT/2;
@@ -668,35 +928,45 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 			break;
 
 		case DTA_Masked:
-			parms->masked = va_arg(tags, INTBOOL);
+			parms->masked = tags.Int();
 			break;
 
 		case DTA_BilinearFilter:
-			parms->bilinear = va_arg(tags, INTBOOL);
+			parms->bilinear = tags.Int();
 			break;
 
 		case DTA_KeepRatio:
 			// I think this is a terribly misleading name, since it actually turns
 			// *off* aspect ratio correction.
-			parms->keepratio = va_arg(tags, INTBOOL);
+			parms->keepratio = tags.Int();
 			break;
 
 		case DTA_RenderStyle:
-			parms->style.AsDWORD = va_arg(tags, DWORD);
+			parms->style.AsDWORD = tags.UInt();
 			break;
 
 		case DTA_SpecialColormap:
-			parms->specialcolormap = va_arg(tags, FSpecialColormap *);
+			parms->specialcolormap = (FSpecialColormap *)tags.Ptr();
 			break;
 
 		case DTA_ColormapStyle:
-			parms->colormapstyle = va_arg(tags, FColormapStyle *);
+			parms->colormapstyle = (FColormapStyle *)tags.Ptr();
 			break;
 		}
-		tag = va_arg(tags, DWORD);
 	}
-	va_end (tags);
+}
+
+//==========================================================================
+//
+// DCanvas :: FinishDrawParms
+//
+// Does everything that depends on more than one tag. Returns false if
+// there is nothing to draw.
+//
+//==========================================================================
 
+bool DCanvas::FinishDrawParms (DrawParms *parms) const
+{
 	if (parms->uclip >= parms->dclip || parms->lclip >= parms->rclip)
 	{
 		return false;
@@ -705,7 +975,7 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 	if (parms->virtWidth != Width || parms->virtHeight != Height)
 	{
 		VirtualToRealCoords(parms->x, parms->y, parms->destwidth, parms->destheight,
-			parms->virtWidth, parms->virtHeight, virtBottom, !parms->keepratio);
+			parms->virtWidth, parms->virtHeight, parms->virtBottom, !parms->keepratio);
 	}
 
 	if (parms->destwidth <= 0 || parms->destheight <= 0)
@@ -720,7 +990,7 @@ bool DCanvas::ParseDrawTextureTags (FTexture *img, double x, double y, DWORD tag
 
 	if (parms->style.BlendOp == 255)
 	{
-		if (fillcolorset)
+		if (parms->fillcolorset)
 		{
 			if (parms->alphaChannel)
 			{
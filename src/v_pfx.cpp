@@ -36,6 +36,10 @@
 #include "i_system.h"
 #include "v_palette.h"
 #include "v_pfx.h"
+#include "r_thread.h"
+
+// Frames with fewer rows than this are not worth waking the threads for.
+#define MIN_SLICED_ROWS		64
 
 extern "C"
 {
@@ -148,6 +152,52 @@ void PfxState::SetFormat (int bits, uint32 redMask, uint32 greenMask, uint32 blu
 	}
 }
 
+//==========================================================================
+//
+// PfxState :: ConvertSliced
+//
+// Gamma and the blend flash are already part of GPfxPal, so every pixel
+// only needs the one palette lookup. Each slice converts its own band of
+// rows with the normal converter.
+//
+//==========================================================================
+
+struct FConvertSliceArgs
+{
+	BYTE *Src;
+	int SrcPitch;
+	BYTE *Dest;
+	int DestPitch;
+	int Width, Height;
+};
+
+static void ConvertSlice (int slice, int numslices, void *userdata)
+{
+	const FConvertSliceArgs *args = (const FConvertSliceArgs *)userdata;
+	int y1 = args->Height * slice / numslices;
+	int y2 = args->Height * (slice + 1) / numslices;
+
+	if (y2 > y1)
+	{
+		GPfx.Convert (args->Src + y1 * args->SrcPitch, args->SrcPitch,
+			args->Dest + y1 * args->DestPitch, args->DestPitch, args->Width, y2 - y1,
+			FRACUNIT, FRACUNIT, 0, 0);
+	}
+}
+
+void PfxState::ConvertSliced (BYTE *src, int srcpitch,
+	void *dest, int destpitch, int destwidth, int destheight)
+{
+	if (destheight < MIN_SLICED_ROWS || R_GetSliceCount() <= 1)
+	{
+		Convert (src, srcpitch, dest, destpitch, destwidth, destheight, FRACUNIT, FRACUNIT, 0, 0);
+		return;
+	}
+
+	FConvertSliceArgs args = { src, srcpitch, (BYTE *)dest, destpitch, destwidth, destheight };
+	R_RunSliced (ConvertSlice, &args);
+}
+
 static bool AnalyzeMask (DWORD mask, BYTE *shiftout)
 {
 	BYTE shift = 0;
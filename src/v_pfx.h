@@ -75,6 +75,10 @@ struct PfxState
 	void (*Convert) (BYTE *src, int srcpitch,
 		void *dest, int destpitch, int destwidth, int destheight,
 		fixed_t xstep, fixed_t ystep, fixed_t xfrac, fixed_t yfrac);
+
+	// Unscaled Convert that splits the rows between the render threads.
+	void ConvertSliced (BYTE *src, int srcpitch,
+		void *dest, int destpitch, int destwidth, int destheight);
 };
 
 extern "C"
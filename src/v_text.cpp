@@ -46,6 +46,330 @@
 
 #include "doomstat.h"
 #include "templates.h"
+#include "c_cvars.h"
+#include "m_crc32.h"
+#include "textures/textures.h"
+#include "r_data/r_translate.h"
+#include "SkylineBinPack.h"
+
+CVAR (Bool, vid_textcache, true, CVAR_ARCHIVE)
+
+#define TEXTATLAS_SIZE		1024
+#define MAX_CACHED_TEXTS	512
+#define MAX_CACHED_LENGTH	256
+#define MAX_SEEN_TEXTS		4096
+
+//==========================================================================
+//
+// Text cache
+//
+// Strings that are drawn again and again, like the console and the
+// scoreboard, are rendered once into an atlas and from then on copied to
+// the screen as runs of opaque pixels. That is a lot cheaper than drawing
+// every glyph with DrawTexture. Only opaque, unscaled-font text drawn to
+// the software frame buffer is cached. A string has to be drawn twice
+// before it is cached, so text that changes every frame does not keep
+// throwing everything else out.
+//
+// The text is captured by drawing it normally over two different
+// backgrounds, so the cached pixels are exactly what DrawTexture draws.
+//
+//==========================================================================
+
+struct FTextRun
+{
+	WORD X, Y, Length;
+};
+
+struct FCachedText
+{
+	FFont *Font;
+	int Color;
+	int ScaleX, ScaleY;
+	FString Text;
+	bool Uncacheable;
+	int Left, Top;				// Position relative to the text's origin
+	Rect Box;					// Position in TextAtlas
+	TArray<FTextRun> Runs;
+};
+
+static TArray<BYTE> TextAtlas;
+static SkylineBinPack TextPacker;
+static TArray<FCachedText> CachedTexts;
+static TMap<DWORD, unsigned> CachedTextMap;
+static TMap<DWORD, bool> SeenTexts;
+static bool CapturingText;
+
+//==========================================================================
+//
+// FlushTextCache
+//
+//==========================================================================
+
+static void FlushTextCache ()
+{
+	if (TextAtlas.Size() == 0)
+	{
+		TextAtlas.Resize (TEXTATLAS_SIZE * TEXTATLAS_SIZE);
+	}
+	CachedTexts.Clear ();
+	CachedTextMap.Clear ();
+	TextPacker.Init (TEXTATLAS_SIZE, TEXTATLAS_SIZE, false);
+}
+
+//==========================================================================
+//
+// GetTextBounds
+//
+// Works out the rectangle DrawTextV draws to. Returns false if there is
+// nothing to draw or a glyph is scaled.
+//
+//==========================================================================
+
+static bool GetTextBounds (FFont *font, int x, int y, const BYTE *string, size_t len,
+	int scalex, int scaley, int height, int kerning, int &left, int &top, int &right, int &bottom)
+{
+	const BYTE *ch = string;
+	int cx = x, cy = y;
+	int w;
+
+	left = top = INT_MAX;
+	right = bottom = INT_MIN;
+
+	while (size_t(ch - string) < len)
+	{
+		int c = *ch++;
+
+		if (c == TEXTCOLOR_ESCAPE)
+		{
+			V_ParseFontColor (ch, CR_UNTRANSLATED, CR_UNTRANSLATED);
+			continue;
+		}
+		if (c == '\n')
+		{
+			cx = x;
+			cy += height;
+			continue;
+		}
+
+		FTexture *pic = font->GetChar (c, &w);
+		if (pic != NULL)
+		{
+			if (pic->Scale.X != 1 || pic->Scale.Y != 1)
+			{
+				return false;
+			}
+			int x0 = cx - pic->LeftOffset * scalex;
+			int y0 = cy - pic->TopOffset * scaley;
+			left = MIN (left, x0);
+			top = MIN (top, y0);
+			right = MAX (right, x0 + pic->GetWidth() * scalex);
+			bottom = MAX (bottom, y0 + pic->GetHeight() * scaley);
+		}
+		cx += (w + kerning) * scalex;
+	}
+	return left < right && top < bottom;
+}
+
+//==========================================================================
+//
+// CaptureText
+//
+// Draws the text over two backgrounds and stores everything that was
+// drawn the same over both in the atlas.
+//
+//==========================================================================
+
+static void CaptureText (DCanvas *canvas, FCachedText &text, int x, int y, const char *string, int width, int height, va_list taglist)
+{
+	int pitch = canvas->GetPitch ();
+	BYTE *dest = canvas->GetBuffer () + (y + text.Top) * pitch + x + text.Left;
+	TArray<BYTE> saved(width * height), first(width * height);
+	va_list tags;
+	int i, j;
+
+	saved.Resize (width * height);
+	first.Resize (width * height);
+	for (i = 0; i < height; ++i)
+	{
+		memcpy (&saved[i * width], dest + i * pitch, width);
+		memset (dest + i * pitch, 0, width);
+	}
+
+	CapturingText = true;
+	for (j = 0; j < 2; ++j)
+	{
+#ifndef NO_VA_COPY
+		va_copy (tags, taglist);
+#else
+		tags = taglist;
+#endif
+		canvas->DrawTextV (text.Font, text.Color, x, y, string, tags);
+		if (j == 0)
+		{
+			for (i = 0; i < height; ++i)
+			{
+				memcpy (&first[i * width], dest + i * pitch, width);
+				memset (dest + i * pitch, 255, width);
+			}
+		}
+	}
+	CapturingText = false;
+
+	BYTE *atlas = &TextAtlas[text.Box.y * TEXTATLAS_SIZE + text.Box.x];
+	for (i = 0; i < height && !text.Uncacheable; ++i)
+	{
+		const BYTE *a = &first[i * width];
+		const BYTE *b = dest + i * pitch;
+
+		memcpy (atlas + i * TEXTATLAS_SIZE, b, width);
+		for (j = 0; j < width; )
+		{
+			if (a[j] == 0 && b[j] == 255)
+			{
+				j++;
+				continue;
+			}
+			FTextRun run = { WORD(j), WORD(i), 0 };
+			for (; j < width && !(a[j] == 0 && b[j] == 255); ++j)
+			{
+				if (a[j] != b[j])
+				{ // Not opaque
+					text.Uncacheable = true;
+				}
+				run.Length++;
+			}
+			text.Runs.Push (run);
+		}
+	}
+
+	for (i = 0; i < height; ++i)
+	{
+		memcpy (dest + i * pitch, &saved[i * width], width);
+	}
+}
+
+//==========================================================================
+//
+// DrawCachedText
+//
+// Returns false if the text has to be drawn normally.
+//
+//==========================================================================
+
+static bool DrawCachedText (DCanvas *canvas, FFont *font, int normalcolor, int x, int y, const char *string,
+	int maxstrlen, int scalex, int scaley, int height, int kerning, va_list taglist)
+{
+	if (!vid_textcache || CapturingText || canvas != screen || screen->Accel2D || canvas->GetBuffer() == NULL)
+	{
+		return false;
+	}
+
+	size_t len = strlen (string);
+	if (len > size_t(maxstrlen))
+	{
+		len = maxstrlen;
+	}
+	if (len == 0 || len > MAX_CACHED_LENGTH)
+	{
+		return false;
+	}
+
+	DWORD hash = CalcCRC32 ((const BYTE *)string, (unsigned)len);
+	hash = AddCRC32 (hash, (const BYTE *)&font, sizeof(font));
+	hash = AddCRC32 (hash, (const BYTE *)&normalcolor, sizeof(normalcolor));
+	hash = AddCRC32 (hash, (const BYTE *)&scalex, sizeof(scalex));
+	hash = AddCRC32 (hash, (const BYTE *)&scaley, sizeof(scaley));
+
+	FCachedText *text;
+	unsigned *index = CachedTextMap.CheckKey (hash);
+	if (index != NULL)
+	{
+		text = &CachedTexts[*index];
+		if (text->Font != font || text->Color != normalcolor || text->ScaleX != scalex || text->ScaleY != scaley ||
+			text->Text.Len() != len || memcmp (text->Text.GetChars(), string, len) != 0)
+		{ // Hash collision
+			return false;
+		}
+	}
+	else
+	{
+		if (SeenTexts.CheckKey (hash) == NULL)
+		{
+			if (SeenTexts.CountUsed() >= MAX_SEEN_TEXTS)
+			{
+				SeenTexts.Clear ();
+			}
+			SeenTexts[hash] = true;
+			return false;
+		}
+
+		int left, top, right, bottom;
+		if (!GetTextBounds (font, x, y, (const BYTE *)string, len, scalex, scaley, height, kerning, left, top, right, bottom) ||
+			left < 0 || top < 0 || right > canvas->GetWidth() || bottom > canvas->GetHeight())
+		{
+			return false;
+		}
+		int width = right - left;
+		int textheight = bottom - top;
+		if (width > TEXTATLAS_SIZE || textheight > TEXTATLAS_SIZE)
+		{
+			return false;
+		}
+
+		if (TextAtlas.Size() == 0 || CachedTexts.Size() >= MAX_CACHED_TEXTS)
+		{
+			FlushTextCache ();
+		}
+		Rect box = TextPacker.Insert (width, textheight);
+		if (box.width != width || box.height != textheight)
+		{
+			FlushTextCache ();
+			box = TextPacker.Insert (width, textheight);
+			if (box.width != width || box.height != textheight)
+			{
+				return false;
+			}
+		}
+
+		unsigned i = CachedTexts.Reserve (1);
+		text = &CachedTexts[i];
+		text->Font = font;
+		text->Color = normalcolor;
+		text->ScaleX = scalex;
+		text->ScaleY = scaley;
+		text->Text = FString (string, len);
+		text->Uncacheable = false;
+		text->Left = left - x;
+		text->Top = top - y;
+		text->Box = box;
+		text->Runs.Clear ();
+		CachedTextMap[hash] = i;
+
+		CaptureText (canvas, *text, x, y, string, width, textheight, taglist);
+	}
+
+	if (text->Uncacheable)
+	{
+		return false;
+	}
+
+	int x0 = x + text->Left, y0 = y + text->Top;
+	if (x0 < 0 || y0 < 0 || x0 + text->Box.width > canvas->GetWidth() || y0 + text->Box.height > canvas->GetHeight())
+	{
+		return false;
+	}
+
+	int pitch = canvas->GetPitch ();
+	BYTE *dest = canvas->GetBuffer () + y0 * pitch + x0;
+	const BYTE *src = &TextAtlas[text->Box.y * TEXTATLAS_SIZE + text->Box.x];
+	for (unsigned i = 0; i < text->Runs.Size(); ++i)
+	{
+		const FTextRun &run = text->Runs[i];
+		memcpy (dest + run.Y * pitch + run.X, src + run.Y * TEXTATLAS_SIZE + run.X, run.Length);
+	}
+	return true;
+}
 
 //
 // DrawChar
@@ -96,7 +420,9 @@ void DCanvas::DrawTextV(FFont *font, int normalcolor, int x, int y, const char *
 	int			forcedwidth = 0;
 	int			scalex, scaley;
 	int			kerning;
+	bool		cacheable = true;
 	FTexture *pic;
+	FDrawTagList charparms;
 
 	if (font == NULL || string == NULL)
 		return;
@@ -131,8 +457,9 @@ void DCanvas::DrawTextV(FFont *font, int normalcolor, int x, int y, const char *
 
 		switch (tag)
 		{
-		case TAG_IGNORE:
 		default:
+			cacheable = false;
+		case TAG_IGNORE:
 			data = va_arg (tags, DWORD);
 			break;
 
@@ -180,12 +507,22 @@ void DCanvas::DrawTextV(FFont *font, int normalcolor, int x, int y, const char *
 			{
 				scalex = scaley = 1;
 				maxwidth = 320;
+				cacheable = false;
 			}
 			break;
 
 		case DTA_VirtualWidth:
 			maxwidth = va_arg (tags, int);
 			scalex = scaley = 1;
+			cacheable = false;
+			break;
+
+		case DTA_Alpha:
+			cacheable &= va_arg (tags, fixed_t) >= OPAQUE;
+			break;
+
+		case DTA_AlphaF:
+			cacheable &= va_arg (tags, double) >= 1.;
 			break;
 
 		case DTA_TextLen:
@@ -194,10 +531,12 @@ void DCanvas::DrawTextV(FFont *font, int normalcolor, int x, int y, const char *
 
 		case DTA_CellX:
 			forcedwidth = va_arg (tags, int);
+			cacheable = false;
 			break;
 
 		case DTA_CellY:
 			height = va_arg (tags, int);
+			cacheable = false;
 			break;
 		}
 		tag = va_arg (tags, uint32);
@@ -205,6 +544,12 @@ void DCanvas::DrawTextV(FFont *font, int normalcolor, int x, int y, const char *
 	va_end(tags);
 
 	height *= scaley;
+
+	if (cacheable && DrawCachedText (this, font, normalcolor, x, y, string, maxstrlen, scalex, scaley, height, kerning, taglist))
+	{
+		va_end(taglist);
+		return;
+	}
 		
 	while ((const char *)ch - string < maxstrlen)
 	{
@@ -231,27 +576,39 @@ void DCanvas::DrawTextV(FFont *font, int normalcolor, int x, int y, const char *
 
 		if (NULL != (pic = font->GetChar (c, &w)))
 		{
-#ifndef NO_VA_COPY
-			va_copy(tags, taglist);
-#else
-			tags = taglist;
-#endif
+			// This is DrawTexture with DTA_Translation and the cell size in
+			// front of the caller's tags. Those are read from the varargs
+			// for the first character and replayed for all the others.
+			DrawParms parms;
+
 			if (forcedwidth)
 			{
 				w = forcedwidth;
-				DrawTexture (pic, cx, cy,
-					DTA_Translation, range,
-					DTA_DestWidth, forcedwidth,
-					DTA_DestHeight, height,
-					TAG_MORE, &tags);
 			}
-			else
+			if (InitDrawParms (pic, cx, cy, &parms))
 			{
-				DrawTexture (pic, cx, cy,
-					DTA_Translation, range,
-					TAG_MORE, &tags);
+				parms.remap = const_cast<FRemapTable *>(range);
+				if (parms.remap != NULL && parms.remap->Inactive)
+				{
+					parms.remap = NULL;
+				}
+				if (forcedwidth)
+				{
+					parms.destwidth = forcedwidth;
+					parms.destheight = height;
+				}
+				if (charparms.Complete)
+				{
+					FDrawTagReader reader(charparms);
+					ParseDrawTags (pic, reader, &parms);
+				}
+				else
+				{
+					FDrawTagReader reader(taglist, &charparms);
+					ParseDrawTags (pic, reader, &parms);
+				}
+				DrawTexture (pic, parms);
 			}
-			va_end (tags);
 		}
 		cx += (w + kerning) * scalex;
 	}
@@ -64,6 +64,7 @@
 #include "r_renderer.h"
 #include "menu/menu.h"
 #include "r_data/voxels.h"
+#include "stats.h"
 
 
 FRenderer *Renderer;
@@ -107,6 +108,39 @@ public:
 };
 IMPLEMENT_ABSTRACT_CLASS (DDummyFrameBuffer)
 
+// A frame buffer that only exists in memory, for running without a display.
+class DHeadlessFrameBuffer : public DFrameBuffer
+{
+	DECLARE_CLASS (DHeadlessFrameBuffer, DFrameBuffer);
+public:
+	DHeadlessFrameBuffer (int width, int height)
+		: DFrameBuffer (width, height)
+	{
+		for (int i = 0; i < 256; ++i)
+		{
+			Palette[i] = GPalette.BaseColors[i];
+		}
+	}
+	bool Lock(bool buffered) { return DSimpleCanvas::Lock(buffered); }
+	void Update() { Unlock(); }
+	PalEntry *GetPalette() { return Palette; }
+	void GetFlashedPalette(PalEntry palette[256]) { memcpy(palette, Palette, sizeof(Palette)); }
+	void UpdatePalette() {}
+	bool SetGamma(float gamma) { return true; }
+	bool SetFlash(PalEntry rgb, int amount) { return false; }
+	void GetFlash(PalEntry &rgb, int &amount) { rgb = 0; amount = 0; }
+	int GetPageCount() { return 1; }
+	bool IsFullscreen() { return false; }
+#ifdef _WIN32
+	void PaletteChanged() {}
+	int QueryNewPalette() { return 0; }
+	bool Is8BitMode() { return true; }
+#endif
+
+	PalEntry Palette[256];
+};
+IMPLEMENT_ABSTRACT_CLASS (DHeadlessFrameBuffer)
+
 // SimpleCanvas is not really abstract, but this macro does not
 // try to generate a CreateNew() function.
 IMPLEMENT_ABSTRACT_CLASS (DSimpleCanvas)
@@ -146,6 +180,8 @@ ColorTable32k RGB32k;
 
 static DWORD Col2RGB8_2[63][256];
 
+cycle_t DimCycles;		// Time spent in DCanvas::Dim this frame
+
 // [RH] The framebuffer is no longer a mere byte array.
 // There's also only one, not four.
 DFrameBuffer *screen;
@@ -212,6 +248,7 @@ DCanvas::DCanvas (int _width, int _height)
 	// Init member vars
 	Buffer = NULL;
 	LockCount = 0;
+	Bgra = false;
 	Width = _width;
 	Height = _height;
 
@@ -343,8 +380,12 @@ void DCanvas::Dim (PalEntry color, float damount, int x1, int y1, int w, int h)
 	if (damount == 0.f)
 		return;
 
-	DWORD *bg2rgb;
-	DWORD fg;
+	// The result only depends on the color under each pixel, so it is
+	// looked up from a table built once per color and amount.
+	static BYTE dimtable[256];
+	static DWORD tablefg;
+	static int tableamount = -1;
+
 	int gap;
 	BYTE *spot;
 	int x, y;
@@ -366,32 +407,51 @@ void DCanvas::Dim (PalEntry color, float damount, int x1, int y1, int w, int h)
 		return;
 	}
 
+	DimCycles.Clock();
 	{
 		int amount;
+		DWORD fg;
 
 		amount = (int)(damount * 64);
-		bg2rgb = Col2RGB8[64-amount];
 
 		fg = (((color.r * amount) >> 4) << 20) |
 			  ((color.g * amount) >> 4) |
 			 (((color.b * amount) >> 4) << 10);
+
+		if (fg != tablefg || amount != tableamount)
+		{
+			DWORD *bg2rgb = Col2RGB8[64-amount];
+
+			for (int i = 0; i < 256; ++i)
+			{
+				DWORD bg = (fg+bg2rgb[i]) | 0x1f07c1f;
+				dimtable[i] = RGB32k.All[bg&(bg>>15)];
+			}
+			tablefg = fg;
+			tableamount = amount;
+		}
 	}
 
 	spot = Buffer + x1 + y1*Pitch;
 	gap = Pitch - w;
 	for (y = h; y != 0; y--)
 	{
-		for (x = w; x != 0; x--)
+		for (x = w; x >= 4; x -= 4)
 		{
-			DWORD bg;
-
-			bg = bg2rgb[(*spot)&0xff];
-			bg = (fg+bg) | 0x1f07c1f;
-			*spot = RGB32k.All[bg&(bg>>15)];
+			spot[0] = dimtable[spot[0]];
+			spot[1] = dimtable[spot[1]];
+			spot[2] = dimtable[spot[2]];
+			spot[3] = dimtable[spot[3]];
+			spot += 4;
+		}
+		for (; x != 0; x--)
+		{
+			*spot = dimtable[*spot];
 			spot++;
 		}
 		spot += gap;
 	}
+	DimCycles.Unclock();
 }
 
 //==========================================================================
@@ -721,9 +781,11 @@ void DCanvas::CalcGamma (float gamma, BYTE gammalookup[256])
 //
 //==========================================================================
 
-DSimpleCanvas::DSimpleCanvas (int width, int height)
+DSimpleCanvas::DSimpleCanvas (int width, int height, bool bgra)
 	: DCanvas (width, height)
 {
+	Bgra = bgra;
+
 	// Making the pitch a power of 2 is very bad for performance
 	// Try to maximize the number of cache lines that can be filled
 	// for each column drawing operation by making the pitch slightly
@@ -759,8 +821,9 @@ DSimpleCanvas::DSimpleCanvas (int width, int height)
 			Pitch = width + MAX(0, CPU.DataL1LineSize - 8);
 		}
 	}
-	MemBuffer = new BYTE[Pitch * height];
-	memset (MemBuffer, 0, Pitch * height);
+	int bytes = Pitch * height * (bgra ? 4 : 1);
+	MemBuffer = new BYTE[bytes];
+	memset (MemBuffer, 0, bytes);
 }
 
 //==========================================================================
@@ -1607,6 +1670,39 @@ void V_Init2()
 	setsizeneeded = true;
 }
 
+//==========================================================================
+//
+// V_InitHeadless
+//
+// Used instead of V_Init2 when nothing is ever shown, like for
+// -benchrender. The screen stays in memory at the size V_Init picked,
+// so the graphics system is never started.
+//
+//==========================================================================
+
+void V_InitHeadless()
+{
+	assert (screen->IsKindOf(RUNTIME_CLASS(DDummyFrameBuffer)));
+	int width = screen->GetWidth();
+	int height = screen->GetHeight();
+
+	{
+		DFrameBuffer *s = screen;
+		screen = NULL;
+		s->ObjectFlags |= OF_YesReallyDelete;
+		delete s;
+	}
+
+	screen = new DHeadlessFrameBuffer (width, height);
+	Printf ("Resolution: %d x %d (headless)\n", SCREENWIDTH, SCREENHEIGHT);
+
+	Renderer->RemapVoxels();
+	FBaseCVar::ResetColors ();
+	C_NewModeAdjust();
+	V_SetBorderNeedRefresh();
+	setsizeneeded = true;
+}
+
 void V_Shutdown()
 {
 	if (screen)
@@ -170,6 +170,56 @@ struct DrawParms
 	FRenderStyle style;
 	struct FSpecialColormap *specialcolormap;
 	struct FColormapStyle *colormapstyle;
+	bool virtBottom;
+	bool fillcolorset;
+};
+
+// The values read from a DrawTexture tag list, in the order they were read.
+// DrawText reads the tag list once and replays it for every character.
+struct FDrawTagList
+{
+	enum { MAX_VALUES = 48 };
+
+	union
+	{
+		uint32 UInt;
+		int Int;
+		double Float;
+		void *Ptr;
+	} Values[MAX_VALUES];
+	int NumValues;
+	bool Complete;		// Everything up to TAG_DONE has been recorded
+	bool Overflow;		// The tag list did not fit
+
+	FDrawTagList() : NumValues(0), Complete(false), Overflow(false) {}
+};
+
+// Reads a tag list either from varargs, optionally recording it, or from
+// an FDrawTagList. TAG_MORE is followed here, so callers never see it.
+class FDrawTagReader
+{
+public:
+	FDrawTagReader (va_list tags, FDrawTagList *record = NULL);
+	FDrawTagReader (uint32 first, va_list tags, FDrawTagList *record = NULL);
+	FDrawTagReader (const FDrawTagList &list);
+	~FDrawTagReader ();
+
+	uint32 Tag ();
+	int Int ();
+	uint32 UInt ();
+	double Float ();
+	void *Ptr ();
+
+private:
+	va_list Tags;
+	bool HasTags;
+	bool HasFirst;
+	uint32 First;
+	FDrawTagList *Record;
+	const FDrawTagList *List;
+	int Pos;
+
+	void Init (va_list tags, FDrawTagList *record);
 };
 
 //
@@ -189,6 +239,7 @@ public:
 	inline int GetWidth () const { return Width; }
 	inline int GetHeight () const { return Height; }
 	inline int GetPitch () const { return Pitch; }
+	inline bool IsBgra () const { return Bgra; }	// Pixels are 4-byte BGRA, Pitch still counts pixels
 
 	virtual bool IsValid ();
 
@@ -242,6 +293,13 @@ public:
 
 	// 2D Texture drawing
 	void STACK_ARGS DrawTexture (FTexture *img, double x, double y, int tags, ...);
+
+	// Typed version of the above: fill parms with InitDrawParms, change
+	// whatever the tags would have changed, and pass them here. The same
+	// parms can be used for any number of calls with the same image.
+	bool InitDrawParms (FTexture *img, double x, double y, DrawParms *parms) const;
+	void ParseDrawTags (FTexture *img, FDrawTagReader &tags, DrawParms *parms) const;
+	void DrawTexture (FTexture *img, const DrawParms &parms);
 	void FillBorder (FTexture *img);	// Fills the border around a 4:3 part of the screen on non-4:3 displays
 	void VirtualToRealCoords(double &x, double &y, double &w, double &h, double vwidth, double vheight, bool vbottom=false, bool handleaspect=true) const;
 
@@ -263,13 +321,15 @@ protected:
 	int Height;
 	int Pitch;
 	int LockCount;
+	bool Bgra;
 
 	bool ClipBox (int &left, int &top, int &width, int &height, const BYTE *&src, const int srcpitch) const;
 	void DrawTextureV(FTexture *img, double x, double y, uint32 tag, va_list tags) = delete;
 	virtual void DrawTextureParms(FTexture *img, DrawParms &parms);
 	bool ParseDrawTextureTags (FTexture *img, double x, double y, uint32 tag, va_list tags, DrawParms *parms, bool fortext) const;
+	bool FinishDrawParms (DrawParms *parms) const;
 
-	DCanvas() {}
+	DCanvas() : Bgra(false) {}
 
 private:
 	// Keep track of canvases, for automatic destruction at exit
@@ -285,7 +345,7 @@ class DSimpleCanvas : public DCanvas
 {
 	DECLARE_CLASS (DSimpleCanvas, DCanvas)
 public:
-	DSimpleCanvas (int width, int height);
+	DSimpleCanvas (int width, int height, bool bgra=false);
 	~DSimpleCanvas ();
 
 	bool IsValid ();
@@ -479,6 +539,9 @@ void V_Init (bool restart);
 // Initializes graphics mode for the first time.
 void V_Init2 ();
 
+// Sets up a screen in memory instead, without any graphics mode.
+void V_InitHeadless ();
+
 void V_Shutdown ();
 
 void V_MarkRect (int x, int y, int width, int height);